@@ -0,0 +1,404 @@
+// Benchmark del tempo di compilazione di kcomp su corpora sintetici.
+//
+// Il generatore produce programmi in linguaggio "kaleidoscope imperativo"
+// parametrizzati per numero di funzioni, profondità di annidamento,
+// dimensione delle espressioni, densità dei cicli e uso degli array; per ogni
+// corpus kcomp viene eseguito come processo separato (tempo end-to-end e
+// picco di memoria residente) e i risultati sono scritti in formato JSON.
+// Si veda il README della cartella per la compilazione e l'uso.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+// Parametri di un corpus
+struct Params {
+  unsigned functions = 100; // Numero di funzioni
+  unsigned depth = 2;       // Profondità massima di annidamento delle istruzioni
+  unsigned expr = 8;        // Numero di operatori binari in ogni espressione
+  unsigned stmts = 4;       // Istruzioni per blocco
+  double loops = 0.3;       // Probabilità che un'istruzione composta sia un ciclo
+  double arrays = 0.3;      // Probabilità di accesso a un array locale
+  unsigned seed = 1;        // Seme del generatore pseudocasuale
+};
+
+// Generatore di un corpus: oltre al testo conta i token emessi e i nodi
+// dell'AST che il parser costruirà per riconoscerlo
+class Generator {
+  const Params &P;
+  std::mt19937 rng;
+  std::ostringstream out;
+  std::vector<std::string> scope; // Variabili visibili nel punto corrente
+  unsigned fn = 0;                // Indice della funzione in corso di generazione
+  unsigned indent = 0;
+
+  void tok(const std::string &t) { out << t << ' '; tokens++; }
+  void node(unsigned n = 1) { nodes += n; }
+  void newline() {
+    out << '\n' << std::string(2*indent, ' ');
+  }
+  bool chance(double p) { return std::uniform_real_distribution<>(0, 1)(rng) < p; }
+  unsigned pick(unsigned n) { return std::uniform_int_distribution<unsigned>(0, n-1)(rng); }
+
+  // Valore foglia: variabile, costante o elemento dell'array locale V
+  void leaf() {
+    if (P.arrays > 0 && chance(P.arrays)) {
+      // L'indice è una costante entro i limiti dell'array (8 elementi)
+      tok("V"); tok("["); tok(std::to_string(pick(8))); tok("]");
+      node(2);
+    } else if (chance(0.75)) {
+      tok(scope[pick(scope.size())]);
+      node();
+    } else {
+      tok(std::to_string(1 + pick(9)));
+      node();
+    }
+  }
+
+  // Espressione con n operatori binari; a volte chiama la funzione precedente
+  void expression(unsigned n) {
+    if (n == 0) {
+      leaf();
+      return;
+    }
+    if (fn > 0 && n >= 3 && chance(0.1)) {
+      tok("f" + std::to_string(fn-1)); tok("(");
+      node();
+      for (unsigned k = 0; k < 2; k++) {
+        if (k) tok(",");
+        leaf();
+      }
+      tok(")");
+      return;
+    }
+    static const char *ops[] = {"+", "-", "*", "+"};
+    unsigned l = pick(n);
+    bool paren = chance(0.3);
+    if (paren) tok("(");
+    expression(l);
+    tok(ops[pick(4)]);
+    node();
+    expression(n-1-l);
+    if (paren) tok(")");
+  }
+
+  // Condizione di confronto fra due espressioni
+  void condition() {
+    expression(P.expr / 2);
+    tok(chance(0.5) ? "<" : ">");
+    node();
+    expression(P.expr / 2);
+  }
+
+  void block(unsigned depth) {
+    tok("{");
+    node();
+    indent++;
+    for (unsigned k = 0; k < P.stmts; k++) {
+      if (k) tok(";");
+      newline();
+      statement(depth);
+    }
+    indent--;
+    newline();
+    tok("}");
+  }
+
+  void statement(unsigned depth) {
+    if (depth > 0 && chance(0.5)) {
+      if (chance(P.loops)) {
+        // for (var iD = 0; iD < N; ++iD) { ... }
+        std::string i = "i" + std::to_string(depth);
+        tok("for"); tok("("); tok("var"); tok(i); tok("="); tok("0"); tok(";");
+        tok(i); tok("<"); tok(std::to_string(2 + pick(7))); tok(";");
+        out << "++"; tokens += 2; // "+" "+" per lo scanner
+        tok(i); tok(")");
+        node(11); // For, VarOperation, binding, 0, <, i, N e ++i (4 nodi)
+        scope.push_back(i);
+        block(depth-1);
+        scope.pop_back();
+      } else {
+        tok("if"); tok("(");
+        node();
+        condition();
+        tok(")");
+        block(depth-1);
+        if (chance(0.5)) {
+          tok("else");
+          block(depth-1);
+        }
+      }
+    } else if (P.arrays > 0 && chance(P.arrays)) {
+      tok("V"); tok("["); tok(std::to_string(pick(8))); tok("]"); tok("=");
+      node(2);
+      expression(P.expr);
+    } else {
+      tok(scope[2 + pick(2)]); tok("="); // x oppure y
+      node();
+      expression(P.expr);
+    }
+  }
+
+public:
+  unsigned long tokens = 0, nodes = 0;
+
+  Generator(const Params &P): P(P), rng(P.seed) {}
+
+  std::string generate() {
+    for (fn = 0; fn < P.functions; fn++) {
+      // def fK(a b) { var x = a; var y = b; var V[8] = {...}; ... ; x + y };
+      scope = {"a", "b", "x", "y"};
+      tok("def"); tok("f" + std::to_string(fn)); tok("("); tok("a"); tok("b"); tok(")");
+      tok("{"); tok("var"); tok("x"); tok("="); tok("a"); tok(";");
+      tok("var"); tok("y"); tok("="); tok("b");
+      node(7); // Function, prototipo, blocco, due binding con le loro variabili
+      if (P.arrays > 0) {
+        // L'array è inizializzato perché la lettura di elementi non assegnati
+        // permetterebbe all'ottimizzatore di eliminare l'intero corpo
+        tok(";"); tok("var"); tok("V"); tok("["); tok("8"); tok("]"); tok("="); tok("{");
+        for (unsigned k = 0; k < 8; k++) {
+          if (k) tok(",");
+          tok(std::to_string(k + 1));
+        }
+        tok("}");
+        node(9);
+      }
+      indent = 1;
+      for (unsigned k = 0; k < P.stmts; k++) {
+        tok(";");
+        newline();
+        statement(P.depth);
+      }
+      tok(";");
+      newline();
+      tok("x"); tok("+"); tok("y");
+      node(3);
+      indent = 0;
+      newline();
+      tok("}"); tok(";");
+      out << "\n\n";
+    }
+    return out.str();
+  }
+};
+
+// Risultato di un'esecuzione di kcomp
+struct Run {
+  double seconds = 0;
+  long maxrss_kb = 0;
+  int status = 0;
+};
+
+// Esegue kcomp con gli argomenti dati; l'uscita diagnostica viene scartata
+static Run execute(const std::vector<std::string> &args) {
+  std::vector<char *> argv;
+  for (const std::string &a : args)
+    argv.push_back(const_cast<char *>(a.c_str()));
+  argv.push_back(nullptr);
+  Run r;
+  auto start = std::chrono::steady_clock::now();
+  pid_t pid = fork();
+  if (pid == 0) {
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, 1);
+    dup2(null, 2);
+    execv(argv[0], argv.data());
+    _exit(127);
+  }
+  struct rusage ru;
+  wait4(pid, &r.status, 0, &ru);
+  r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  r.maxrss_kb = ru.ru_maxrss;
+  return r;
+}
+
+// Esegue più volte e restituisce il tempo minimo (il meno disturbato) con il
+// massimo picco di memoria osservato
+static Run measure(const std::vector<std::string> &args, unsigned repeat) {
+  Run best;
+  best.seconds = INFINITY;
+  for (unsigned k = 0; k < repeat; k++) {
+    Run r = execute(args);
+    if (r.status != 0)
+      return r;
+    best.seconds = std::min(best.seconds, r.seconds);
+    best.maxrss_kb = std::max(best.maxrss_kb, r.maxrss_kb);
+  }
+  return best;
+}
+
+// Conta le istruzioni di un file .ll (le righe indentate nei corpi delle funzioni)
+static unsigned long countInstructions(const std::string &file) {
+  std::ifstream in(file);
+  std::string line;
+  unsigned long n = 0;
+  bool body = false;
+  while (std::getline(in, line)) {
+    if (line.rfind("define ", 0) == 0)
+      body = true;
+    else if (line == "}")
+      body = false;
+    else if (body && line.size() > 2 && line[0] == ' ' && line[1] == ' ')
+      n++;
+  }
+  return n;
+}
+
+static const char *optval(const char *arg, const std::string &name) {
+  return std::string(arg).rfind(name + "=", 0) == 0 ? arg + name.size() + 1 : nullptr;
+}
+
+// Imposta il parametro di nome name; false se il nome non esiste
+static bool setParam(Params &P, const std::string &name, const char *val) {
+  if (name == "functions") P.functions = atoi(val);
+  else if (name == "depth") P.depth = atoi(val);
+  else if (name == "expr") P.expr = atoi(val);
+  else if (name == "stmts") P.stmts = atoi(val);
+  else if (name == "loops") P.loops = atof(val);
+  else if (name == "arrays") P.arrays = atof(val);
+  else if (name == "seed") P.seed = atoi(val);
+  else return false;
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  Params P;
+  std::string kcomp = "../kcomp", json, workdir = "/tmp", sweep;
+  std::vector<std::string> values;
+  unsigned repeat = 3;
+  int opt = 2;
+  bool generate = false;
+  const char *val;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    size_t eq = arg.find('=');
+    if (arg == "--generate")
+      generate = true; // Scrive il corpus su stdout senza eseguire kcomp
+    else if ((val = optval(argv[i], "--kcomp")))
+      kcomp = val;
+    else if ((val = optval(argv[i], "--json")))
+      json = val;
+    else if ((val = optval(argv[i], "--workdir")))
+      workdir = val;
+    else if ((val = optval(argv[i], "--repeat")))
+      repeat = std::max(1, atoi(val));
+    else if (arg.size() == 3 && arg[0] == '-' && arg[1] == 'O' && arg[2] >= '0' && arg[2] <= '3')
+      opt = arg[2] - '0';
+    else if ((val = optval(argv[i], "--sweep"))) {
+      // --sweep=parametro:v1,v2,... fa variare un parametro lasciando fissi gli altri
+      std::string s = val;
+      size_t colon = s.find(':');
+      if (colon == std::string::npos) {
+        std::cerr << "--sweep richiede la forma parametro:v1,v2,..." << std::endl;
+        return 1;
+      }
+      sweep = s.substr(0, colon);
+      std::stringstream vs(s.substr(colon + 1));
+      std::string v;
+      while (std::getline(vs, v, ','))
+        values.push_back(v);
+    } else if (arg.rfind("--", 0) != 0 || eq == std::string::npos ||
+               !setParam(P, arg.substr(2, eq - 2), argv[i] + eq + 1)) {
+      std::cerr << "opzione non valida: " << arg << std::endl;
+      return 1;
+    }
+  }
+
+  if (generate) {
+    Generator G(P);
+    std::cout << G.generate();
+    std::cerr << G.tokens << " token, " << G.nodes << " nodi AST" << std::endl;
+    return 0;
+  }
+  if (access(kcomp.c_str(), X_OK) != 0) {
+    std::cerr << "eseguibile kcomp non trovato: " << kcomp << std::endl;
+    return 1;
+  }
+  if (sweep.empty())
+    values.push_back("");
+  else {
+    Params check;
+    if (!setParam(check, sweep, "0")) {
+      std::cerr << "parametro sconosciuto: " << sweep << std::endl;
+      return 1;
+    }
+  }
+
+  std::string base = workdir + "/kbench" + std::to_string(getpid());
+  std::string src = base + ".k", ll = base + ".ll", obj = base + ".o";
+  std::string olevel = "-O" + std::to_string(opt);
+  std::ostringstream js;
+  js << "{\n  \"kcomp\": \"" << kcomp << "\",\n  \"opt_level\": " << opt
+     << ",\n  \"repeat\": " << repeat << ",\n  \"sweep\": \"" << sweep << "\",\n  \"runs\": [";
+  double prevTokens = 0, prevTotal = 0;
+  int res = 0;
+  for (size_t k = 0; k < values.size(); k++) {
+    if (!sweep.empty())
+      setParam(P, sweep, values[k].c_str());
+    Generator G(P);
+    std::string text = G.generate();
+    std::ofstream(src) << text;
+
+    // Le fasi sono ricavate per differenza fra esecuzioni che si fermano in
+    // punti diversi: -O0 --emit=ll comprende scanner, parser, generazione e
+    // verifica dell'IR; l'ottimizzazione e la generazione del codice macchina
+    // si aggiungono nelle esecuzioni successive
+    Run front = measure({kcomp, "-O0", "--emit=ll", "-o", ll, src}, repeat);
+    unsigned long instrs = countInstructions(ll);
+    Run optimized = measure({kcomp, olevel, "--emit=ll", "-o", ll, src}, repeat);
+    unsigned long optInstrs = countInstructions(ll);
+    Run total = measure({kcomp, olevel, "--emit=obj", "-o", obj, src}, repeat);
+    if (front.status || optimized.status || total.status) {
+      std::cerr << "kcomp ha fallito sul corpus " << src << std::endl;
+      res = 1;
+      break;
+    }
+
+    // Pendenza log-log del tempo rispetto ai token fra due punti consecutivi:
+    // valori sensibilmente maggiori di 1 indicano un comportamento superlineare
+    double slope = NAN;
+    if (prevTokens > 0 && G.tokens != prevTokens)
+      slope = std::log(total.seconds / prevTotal) / std::log(G.tokens / prevTokens);
+    prevTokens = G.tokens;
+    prevTotal = total.seconds;
+
+    js << (k ? "," : "") << "\n    {\n"
+       << "      \"params\": {\"functions\": " << P.functions << ", \"depth\": " << P.depth
+       << ", \"expr\": " << P.expr << ", \"stmts\": " << P.stmts << ", \"loops\": " << P.loops
+       << ", \"arrays\": " << P.arrays << ", \"seed\": " << P.seed << "},\n"
+       << "      \"bytes\": " << text.size() << ", \"tokens\": " << G.tokens
+       << ", \"ast_nodes\": " << G.nodes << ", \"ir_instructions\": " << instrs
+       << ", \"ir_instructions_opt\": " << optInstrs << ",\n"
+       << "      \"seconds\": {\"frontend\": " << front.seconds
+       << ", \"optimize\": " << std::max(0.0, optimized.seconds - front.seconds)
+       << ", \"backend\": " << std::max(0.0, total.seconds - optimized.seconds)
+       << ", \"total\": " << total.seconds << "},\n"
+       << "      \"tokens_per_sec\": " << G.tokens / front.seconds
+       << ", \"ast_nodes_per_sec\": " << G.nodes / front.seconds
+       << ", \"ir_instructions_per_sec\": " << instrs / front.seconds << ",\n"
+       << "      \"peak_rss_kb\": " << total.maxrss_kb
+       << ", \"slope\": " << (std::isnan(slope) ? std::string("null") : std::to_string(slope)) << "\n    }";
+    std::cerr << (sweep.empty() ? "" : sweep + "=" + values[k] + ": ") << G.tokens << " token, "
+              << total.seconds << " s, " << total.maxrss_kb << " KB" << std::endl;
+  }
+  js << "\n  ]\n}\n";
+  unlink(src.c_str());
+  unlink(ll.c_str());
+  unlink(obj.c_str());
+  if (json.empty())
+    std::cout << js.str();
+  else
+    std::ofstream(json) << js.str();
+  return res;
+}
@@ -0,0 +1,126 @@
+// Versioni C++ scritte a mano dei kernel misurati da runbench, equivalenti
+// ai programmi .k della cartella test (e a inssort.k). Sono compilate in
+// un'unità di traduzione separata e chiamate tramite puntatore, come le
+// funzioni caricate dalle librerie generate da kcomp, così che nessuna
+// delle due parti possa essere espansa inline nel ciclo di misura.
+// I nomi hanno il prefisso ref_ perché l'eseguibile esporta i propri simboli
+// (-rdynamic) e non deve sostituirsi a quelli delle librerie
+#include <cmath>
+
+extern "C" double printval(double x1, double x2, double flag);
+
+// fibonacciIt.k
+double ref_fibo(double n) {
+  double a = 0, b = 1;
+  for (double i = 1; i < n; ++i) {
+    double oldb = b;
+    b = a + b;
+    a = oldb;
+  }
+  return b;
+}
+
+// sqrt.k
+static double err(double a, double b) { return a < b ? b - a : a - b; }
+
+static double iterate(double y, double x) {
+  double eps = 0.0001;
+  for (double z = x * x; eps < err(z, y); x = (x + y / x) / 2)
+    z = x * x;
+  return x;
+}
+
+double ref_sqrt(double y) {
+  return y == 1 ? 1 : (y < 1 ? iterate(y, 1 - y) : iterate(y, y / 2));
+}
+
+// sqrt2.k
+static double iterate2(double y, double x) {
+  double eps = 0.0001;
+  for (double z = x * x; eps < z - y || eps < y - z; x = (x + y / x) / 2)
+    z = x * x;
+  return x;
+}
+
+double ref_sqrt2(double y) {
+  return y == 1 ? 1 : y < 1 ? iterate2(y, 1 - y) : iterate2(y, y / 2);
+}
+
+// sqrt3.k
+static double iterate3(double y, double x) {
+  double eps = 0.0001;
+  for (double z = x * x; !(z - y < eps && y - z < eps); x = (x + y / x) / 2)
+    z = x * x;
+  return x;
+}
+
+double ref_sqrt3(double y) {
+  return y == 1 ? 1 : y < 1 ? iterate3(y, 1 - y) : iterate3(y, y / 2);
+}
+
+// eqn2.k
+double ref_eqn2(double a, double b, double c) {
+  double delta2 = b * b - 4 * a * c;
+  if (delta2 < 0) {
+    double delta = std::sqrt(-delta2);
+    return printval(-b / (2 * a), delta / (2 * a), 0);
+  } else if (delta2 == 0) {
+    return printval(-b / (2 * a), 0, 0);
+  } else {
+    double delta = std::sqrt(delta2);
+    return printval((-b + delta) / (2 * a), (-b - delta) / (2 * a), 1);
+  }
+}
+
+// rand.k
+static double seed, a, m;
+
+double ref_randk() {
+  double tmp = a * seed;
+  seed = tmp - m * std::floor(tmp / m);
+  return seed / m;
+}
+
+double ref_randinit(double x) {
+  a = 16897.0;
+  m = 2147483647.0;
+  seed = x - m * std::floor(x / m);
+  return 0.0;
+}
+
+// provaArray.k
+double ref_provaArray(double y) {
+  double size = 10;
+  double V[10];
+  for (int i = 0; i < size; ++i)
+    V[i] = y + i;
+  for (int i = 0; i < size; ++i)
+    printval(V[i], 0, 0);
+  return 0;
+}
+
+// floor.k
+static double pow2(double x, double i) { return x < 2 * i ? i : pow2(x, 2 * i); }
+
+static double intpart(double x, double acc) {
+  double y = x < 1 ? 0 : pow2(x, 1);
+  return y == 0 ? acc : intpart(x - y, acc + y);
+}
+
+double ref_floor(double x) { return intpart(x, 0); }
+
+// inssort.k
+double ref_A[1000];
+
+double ref_inssort(double n) {
+  for (int i = 1; i < n; ++i) {
+    double x = ref_A[i];
+    int j = i - 1;
+    while (j > -1 && ref_A[j] > x) {
+      ref_A[j + 1] = ref_A[j];
+      j = j - 1;
+    }
+    ref_A[j + 1] = x;
+  }
+  return 0;
+}
@@ -0,0 +1,284 @@
+// Benchmark del codice generato da kcomp.
+//
+// Ogni argomento è una libreria condivisa ottenuta da un programma .k e
+// chiamata <kernel>-<configurazione>.so (ad esempio sqrt2-O3-native.so); il
+// kernel viene misurato insieme alla sua versione C++ di riferimento
+// (reference.cpp). Per ogni misura si eseguono alcuni lotti di riscaldamento,
+// poi un certo numero di campioni, ciascuno formato da un lotto di chiamate
+// la cui dimensione è calibrata perché duri almeno --min-time millisecondi;
+// si riportano media, intervallo di confidenza al 95%, mediana e minimo dei
+// nanosecondi per chiamata. Il processo può essere vincolato a una CPU (--cpu)
+// per ridurre la variabilità dovuta alle migrazioni.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sched.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+double ref_fibo(double);
+double ref_sqrt(double);
+double ref_sqrt2(double);
+double ref_sqrt3(double);
+double ref_eqn2(double, double, double);
+double ref_randk();
+double ref_randinit(double);
+double ref_provaArray(double);
+double ref_floor(double);
+double ref_inssort(double);
+extern double ref_A[1000];
+
+// Funzione esterna usata da eqn2.k e provaArray.k: accumula i valori
+// invece di stamparli, così che le chiamate non possano essere eliminate
+static volatile double sink;
+extern "C" double printval(double x1, double, double) {
+  sink = sink + x1;
+  return 0.0;
+}
+
+// Forma di chiamata di un kernel
+enum Shape { Unary, Ternary, Nullary, Sort };
+
+struct Kernel {
+  const char *name;   // Nome del file .k (senza suffisso)
+  const char *symbol; // Funzione misurata
+  Shape shape;
+  void *ref;          // Versione C++ di riferimento
+};
+
+static const Kernel kernels[] = {
+  {"fibonacciIt", "fibo", Unary, (void *)ref_fibo},
+  {"sqrt", "sqrt", Unary, (void *)ref_sqrt},
+  {"sqrt2", "sqrt", Unary, (void *)ref_sqrt2},
+  {"sqrt3", "sqrt", Unary, (void *)ref_sqrt3},
+  {"eqn2", "eqn2", Ternary, (void *)ref_eqn2},
+  {"rand", "randk", Nullary, (void *)ref_randk},
+  {"provaArray", "provaArray", Unary, (void *)ref_provaArray},
+  {"floor", "floor", Unary, (void *)ref_floor},
+  {"inssort", "inssort", Sort, (void *)ref_inssort},
+};
+
+// Numero di elementi ordinati da ogni chiamata di inssort
+static const unsigned SortSize = 256;
+static const unsigned NumInputs = 64;
+
+// Funzione da misurare con i suoi ingressi
+struct Target {
+  const Kernel *K = nullptr;
+  void *fn = nullptr;
+  double *array = nullptr;    // Array globale ordinato da inssort
+  std::vector<double> in{};   // Ingressi (triple consecutive per eqn2)
+  std::vector<double> data{}; // Dati da ordinare, ricopiati a ogni chiamata
+};
+
+// Ingressi deterministici e rappresentativi di ogni kernel
+static void setInputs(Target &T) {
+  srand(1);
+  auto unif = [](double lo, double hi) { return lo + (hi - lo) * (rand() / (double)RAND_MAX); };
+  std::string name = T.K->name;
+  for (unsigned i = 0; i < NumInputs; i++) {
+    if (name == "fibonacciIt")
+      T.in.push_back(std::floor(unif(20, 80)));
+    else if (name.rfind("sqrt", 0) == 0)
+      T.in.push_back(std::exp(unif(std::log(0.01), std::log(1e4))));
+    else if (name == "floor")
+      T.in.push_back(unif(0, 1e6));
+    else if (name == "eqn2") {
+      // Si alternano i tre casi del discriminante (negativo, nullo, positivo)
+      double a = unif(1, 10), b = unif(-10, 10);
+      double c = i % 3 == 0 ? b*b/(4*a) + unif(1, 10) : i % 3 == 1 ? b*b/(4*a) : b*b/(4*a) - unif(1, 10);
+      T.in.insert(T.in.end(), {a, b, c});
+    } else
+      T.in.push_back(unif(0, 100));
+  }
+  if (T.K->shape == Sort)
+    for (unsigned i = 0; i < SortSize; i++)
+      T.data.push_back(unif(0, 1));
+}
+
+// Esegue n chiamate del kernel
+static void run(Target &T, unsigned long n) {
+  switch (T.K->shape) {
+  case Unary: {
+    auto f = (double (*)(double))T.fn;
+    for (unsigned long i = 0; i < n; i++)
+      sink = sink + f(T.in[i % NumInputs]);
+    break;
+  }
+  case Ternary: {
+    auto f = (double (*)(double, double, double))T.fn;
+    for (unsigned long i = 0; i < n; i++) {
+      const double *x = &T.in[3 * (i % NumInputs)];
+      sink = sink + f(x[0], x[1], x[2]);
+    }
+    break;
+  }
+  case Nullary: {
+    auto f = (double (*)())T.fn;
+    for (unsigned long i = 0; i < n; i++)
+      sink = sink + f();
+    break;
+  }
+  case Sort: {
+    // Il tempo comprende la copia dei dati, uguale per kcomp e C++
+    auto f = (double (*)(double))T.fn;
+    for (unsigned long i = 0; i < n; i++) {
+      memcpy(T.array, T.data.data(), SortSize * sizeof(double));
+      sink = sink + f(SortSize);
+    }
+    break;
+  }
+  }
+}
+
+// Quantili della t di Student per l'intervallo di confidenza bilaterale al 95%
+// (gradi di libertà da 1 a 30; oltre si usa l'approssimazione normale)
+static double student95(unsigned df) {
+  static const double t[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                             2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                             2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+  return df == 0 ? NAN : df <= 30 ? t[df - 1] : 1.960;
+}
+
+struct Stats {
+  double mean, ci, median, min;
+  unsigned long batch;
+};
+
+static double seconds(Target &T, unsigned long n) {
+  auto start = std::chrono::steady_clock::now();
+  run(T, n);
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static Stats measure(Target &T, unsigned samples, unsigned warmup, double minTime) {
+  // Calibrazione: il lotto raddoppia finché non dura almeno minTime
+  unsigned long batch = 1;
+  while (seconds(T, batch) < minTime && batch < (1ul << 40))
+    batch *= 2;
+  for (unsigned k = 0; k < warmup; k++)
+    run(T, batch);
+  std::vector<double> ns;
+  for (unsigned k = 0; k < samples; k++)
+    ns.push_back(seconds(T, batch) * 1e9 / batch);
+  Stats S;
+  S.batch = batch;
+  S.mean = 0;
+  for (double x : ns)
+    S.mean += x;
+  S.mean /= ns.size();
+  double var = 0;
+  for (double x : ns)
+    var += (x - S.mean) * (x - S.mean);
+  var /= std::max<size_t>(1, ns.size() - 1);
+  S.ci = student95(ns.size() - 1) * std::sqrt(var / ns.size());
+  std::sort(ns.begin(), ns.end());
+  S.median = ns.size() % 2 ? ns[ns.size() / 2] : (ns[ns.size() / 2 - 1] + ns[ns.size() / 2]) / 2;
+  S.min = ns.front();
+  return S;
+}
+
+static const char *optval(const char *arg, const std::string &name) {
+  return std::string(arg).rfind(name + "=", 0) == 0 ? arg + name.size() + 1 : nullptr;
+}
+
+int main(int argc, char *argv[]) {
+  unsigned samples = 30, warmup = 5;
+  double minTime = 0.002;
+  int cpu = -1;
+  std::string json;
+  std::vector<std::string> libs;
+  const char *val;
+  for (int i = 1; i < argc; i++) {
+    if ((val = optval(argv[i], "--samples")))
+      samples = std::max(2, atoi(val));
+    else if ((val = optval(argv[i], "--warmup")))
+      warmup = atoi(val);
+    else if ((val = optval(argv[i], "--min-time")))
+      minTime = atof(val) / 1000;
+    else if ((val = optval(argv[i], "--cpu")))
+      cpu = atoi(val);
+    else if ((val = optval(argv[i], "--json")))
+      json = val;
+    else if (argv[i][0] == '-') {
+      std::cerr << "opzione non valida: " << argv[i] << std::endl;
+      return 1;
+    } else
+      libs.push_back(argv[i]);
+  }
+
+  if (cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+      std::cerr << "impossibile vincolare il processo alla CPU " << cpu << std::endl;
+      return 1;
+    }
+  }
+
+  std::ostringstream js;
+  js << "{\n  \"samples\": " << samples << ", \"warmup\": " << warmup << ", \"min_time_ms\": "
+     << minTime * 1000 << ", \"cpu\": " << cpu << ",\n  \"results\": [";
+  std::map<std::string, Stats> refs; // Riferimenti C++ già misurati
+  bool first = true;
+  int res = 0;
+  printf("%-12s %-14s %12s %10s %12s %12s %8s\n", "kernel", "config", "ns/call", "+-95%", "median", "min", "vs C++");
+  for (const std::string &lib : libs) {
+    // <kernel>-<configurazione>.so
+    std::string base = lib.substr(lib.rfind('/') + 1);
+    base = base.substr(0, base.rfind(".so"));
+    size_t dash = base.find('-');
+    std::string name = base.substr(0, dash), config = dash == std::string::npos ? "" : base.substr(dash + 1);
+    const Kernel *K = nullptr;
+    for (const Kernel &k : kernels)
+      if (name == k.name)
+        K = &k;
+    if (!K) {
+      std::cerr << "kernel sconosciuto: " << lib << std::endl;
+      res = 1;
+      continue;
+    }
+    // RTLD_LOCAL: le librerie definiscono gli stessi simboli (sqrt, iterate, ...)
+    void *handle = dlopen(lib.c_str(), RTLD_NOW | RTLD_LOCAL);
+    Target T{K, handle ? dlsym(handle, K->symbol) : nullptr};
+    if (!T.fn) {
+      std::cerr << lib << ": " << dlerror() << std::endl;
+      res = 1;
+      continue;
+    }
+    setInputs(T);
+    if (K->shape == Sort)
+      T.array = (double *)dlsym(handle, "A");
+    if (K->shape == Nullary)
+      ((double (*)(double))dlsym(handle, "randinit"))(42);
+
+    if (!refs.count(name)) {
+      Target R{K, K->ref};
+      setInputs(R);
+      R.array = ref_A;
+      if (K->shape == Nullary)
+        ref_randinit(42);
+      refs[name] = measure(R, samples, warmup, minTime);
+    }
+    Stats S = measure(T, samples, warmup, minTime), &R = refs[name];
+    printf("%-12s %-14s %12.2f %10.2f %12.2f %12.2f %8.2f\n", name.c_str(), config.c_str(),
+           S.mean, S.ci, S.median, S.min, S.mean / R.mean);
+    js << (first ? "" : ",") << "\n    {\"kernel\": \"" << name << "\", \"config\": \"" << config
+       << "\", \"ns_per_call\": " << S.mean << ", \"ci95\": " << S.ci << ", \"median\": " << S.median
+       << ", \"min\": " << S.min << ", \"batch\": " << S.batch << ", \"ref_ns_per_call\": " << R.mean
+       << ", \"ref_ci95\": " << R.ci << ", \"ratio\": " << S.mean / R.mean << "}";
+    first = false;
+  }
+  js << "\n  ]\n}\n";
+  if (!json.empty())
+    std::ofstream(json) << js.str();
+  return res;
+}
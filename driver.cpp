@@ -1,15 +1,15 @@
 #include "driver.hpp"
 #include "parser.hpp"
 
-// Generazione di un'istanza per ciascuna della classi LLVMContext,
-// Module e IRBuilder. Nel caso di singolo modulo è sufficiente
-LLVMContext *context = new LLVMContext;
-Module *module = new Module("Kaleidoscope", *context);
-IRBuilder<> *builder = new IRBuilder(*context);
+// File compilato dal thread corrente: con -j più file sono compilati in
+// parallelo, e ogni messaggio di errore è preceduto dal nome del suo file
+// (scritto con l'errore in un'unica operazione, per non mescolare le righe)
+static thread_local std::string CurrentFile;
 
-Value *LogErrorV(const std::string Str)
+Value *LogErrorV(const Twine &Str)
 {
-  std::cerr << Str << std::endl;
+  std::string Msg = CurrentFile.empty() ? Str.str() : (CurrentFile + ": " + Str).str();
+  std::cerr << Msg + "\n" << std::flush;
   return nullptr;
 }
 
@@ -25,54 +25,1405 @@ Value *LogErrorV(const std::string Str)
    interferire con il builder globale, la generazione viene dunque effettuata
    con un builder temporaneo TmpB
 */
-static AllocaInst *CreateEntryBlockAlloca(Function *fun, StringRef VarName, Type *T = Type::getDoubleTy(*context))
+static AllocaInst *CreateEntryBlockAlloca(Function *fun, StringRef VarName, Type *T = nullptr)
 {
+  if (!T)
+    T = Type::getDoubleTy(fun->getContext());
   IRBuilder<> TmpB(&fun->getEntryBlock(), fun->getEntryBlock().begin());
   return TmpB.CreateAlloca(T, nullptr, VarName);
 }
 
-// Implementazione del costruttore della classe driver
-driver::driver() : trace_parsing(false), trace_scanning(false){};
+/*********************** Optimization remarks **********************/
+// Gestore delle diagnostiche emesse dai passi di LLVM nel contesto di un
+// driver. Stampa le optimization remark dei passi selezionati con -Rpass,
+// -Rpass-missed e -Rpass-analysis (espressioni regolari sul nome del passo,
+// ad esempio loop-vectorize o loop-unroll) e gli avvisi dei passi, come quello
+// emesso quando un suggerimento #vectorize non può essere rispettato
+struct diagnostics : public DiagnosticHandler
+{
+  const driver &drv;
+  std::optional<Regex> Passed, Missed, Analysis;
+  diagnostics(const driver &drv) : drv(drv)
+  {
+    if (!drv.opts.rpass.empty())
+      Passed.emplace(drv.opts.rpass);
+    if (!drv.opts.rpass_missed.empty())
+      Missed.emplace(drv.opts.rpass_missed);
+    if (!drv.opts.rpass_analysis.empty())
+      Analysis.emplace(drv.opts.rpass_analysis);
+  }
+  bool isPassedOptRemarkEnabled(StringRef PassName) const override
+  {
+    return Passed && Passed->match(PassName);
+  }
+  bool isMissedOptRemarkEnabled(StringRef PassName) const override
+  {
+    return Missed && Missed->match(PassName);
+  }
+  bool isAnalysisRemarkEnabled(StringRef PassName) const override
+  {
+    return Analysis && Analysis->match(PassName);
+  }
+  bool isAnyRemarkEnabled() const override
+  {
+    return Passed || Missed || Analysis;
+  }
+  bool handleDiagnostics(const DiagnosticInfo &DI) override;
+};
+
+// Le diagnostiche sono stampate nella forma file:riga:colonna: remark: ...;
+// la posizione è disponibile solo se il modulo ha informazioni di debug.
+// Ogni diagnostica è scritta con una sola operazione, perché driver diversi
+// possono stampare contemporaneamente (-j)
+bool diagnostics::handleDiagnostics(const DiagnosticInfo &DI)
+{
+  auto *R = dyn_cast<DiagnosticInfoOptimizationBase>(&DI);
+  if (!R || (DI.getSeverity() != DS_Remark && DI.getSeverity() != DS_Warning))
+    return false;
+  if (!R->isEnabled())
+    return true;
+  std::string Msg;
+  raw_string_ostream OS(Msg);
+  OS << drv.file;
+  if (R->isLocationAvailable())
+  {
+    StringRef Path;
+    unsigned Line, Column;
+    R->getLocation(Path, Line, Column);
+    OS << ":" << Line << ":" << Column;
+  }
+  OS << (DI.getSeverity() == DS_Remark ? ": remark: " : ": warning: ");
+  OS << R->getFunction().getName() << ": " << R->getMsg();
+  // Come in clang, la remark indica l'opzione che la abilita. Le remark che
+  // accompagnano un suggerimento non rispettato sono sempre stampate e non
+  // hanno un passo associato
+  const char *Flag = R->isPassed() ? "-Rpass" : R->isMissed() ? "-Rpass-missed"
+                     : R->isAnalysis() ? "-Rpass-analysis" : nullptr;
+  if (Flag && R->getPassName().empty())
+    OS << " [" << Flag << "]";
+  else if (Flag)
+    OS << " [" << Flag << "=" << R->getPassName() << "]";
+  OS << "\n";
+  errs() << OS.str();
+  return true;
+}
+
+// Implementazione del costruttore della classe driver. Viene generata
+// un'istanza per ciascuna della classi LLVMContext, Module e IRBuilder,
+// di uso esclusivo del file compilato da questo driver. Il contesto riceve
+// il gestore delle diagnostiche (optimization remark) del driver
+driver::driver(const options &opts) : opts(opts), context(std::make_unique<LLVMContext>()),
+                                      module(std::make_unique<Module>("Kaleidoscope", *context)),
+                                      builder(std::make_unique<IRBuilder<>>(*context))
+{
+  context->setDiagnosticHandler(std::make_unique<diagnostics>(*this));
+  Stats.Enabled = opts.time_report || !opts.stats_file.empty();
+};
+
+// Il modulo deve essere distrutto prima del contesto che lo contiene; i pass
+// manager (che possono mantenere analisi sulle funzioni) prima ancora
+driver::~driver()
+{
+  optimizer.reset();
+  builder.reset();
+  module.reset();
+};
+
+/************************* Debug info ****************************/
+thread_local SourceLoc RootAST::NextLoc;
+
+// Con -g il modulo riceve un'unità di compilazione DWARF e ogni funzione un
+// DISubprogram; le istruzioni sono associate alla riga e alla colonna del
+// nodo da cui sono generate, così che debugger e profiler (perf annotate)
+// riconducano il codice macchina, anche ottimizzato, alle righe del sorgente
+DebugLocation::DebugLocation(driver &drv, const RootAST *Node)
+{
+  if (!drv.DBuilder || !Node->Loc.Line || drv.DScopes.empty())
+    return;
+  this->drv = &drv;
+  Saved = drv.builder->getCurrentDebugLocation();
+  drv.builder->SetCurrentDebugLocation(
+      DILocation::get(*drv.context, Node->Loc.Line, Node->Loc.Col, drv.DScopes.back()));
+}
+
+DebugLocation::~DebugLocation()
+{
+  if (drv)
+    drv->builder->SetCurrentDebugLocation(Saved);
+}
+
+DIType *driver::debugType(Type *T)
+{
+  if (T->isIntegerTy())
+    return DBuilder->createBasicType("long", 64, dwarf::DW_ATE_signed);
+  if (T->isPointerTy())
+    return DBuilder->createPointerType(debugType(Type::getDoubleTy(*context)), 64);
+  if (auto *VT = dyn_cast<FixedVectorType>(T))
+  {
+    Metadata *Range = DBuilder->getOrCreateSubrange(0, VT->getNumElements());
+    return DBuilder->createVectorType(64 * VT->getNumElements(), 64 * VT->getNumElements(),
+                                      debugType(VT->getElementType()), DBuilder->getOrCreateArray(Range));
+  }
+  if (auto *AT = dyn_cast<ArrayType>(T))
+  {
+    Metadata *Range = DBuilder->getOrCreateSubrange(0, AT->getNumElements());
+    return DBuilder->createArrayType(64 * AT->getNumElements(), 64, debugType(AT->getElementType()),
+                                     DBuilder->getOrCreateArray(Range));
+  }
+  return DBuilder->createBasicType("double", 64, dwarf::DW_ATE_float);
+}
+
+// La dichiarazione (llvm.dbg.declare) lega la variabile alla sua area di
+// memoria; dopo mem2reg diventa una serie di llvm.dbg.value
+void driver::declareVariable(AllocaInst *A, StringRef Name, SourceLoc Loc, unsigned ArgNo)
+{
+  if (!DBuilder || DScopes.empty())
+    return;
+  DIScope *Scope = DScopes.back();
+  DIType *T = debugType(A->getAllocatedType());
+  DILocalVariable *V = ArgNo ? DBuilder->createParameterVariable(Scope, Name, ArgNo, DFile, Loc.Line, T, true)
+                             : DBuilder->createAutoVariable(Scope, Name, DFile, Loc.Line, T, true);
+  DBuilder->insertDeclare(A, V, DBuilder->createExpression(),
+                          DILocation::get(*context, Loc.Line, Loc.Col, Scope), builder->GetInsertBlock());
+}
+
+/************************* Profiling *****************************/
+// Con --instrument ogni funzione chiama __kcomp_prof_enter all'ingresso e
+// __kcomp_prof_exit prima del return, passando il descrittore del proprio
+// sito; con --instrument=loops ogni ciclo conta le iterazioni in una variabile
+// locale (promossa a registro da mem2reg, così che il corpo resti
+// vettorizzabile) e le comunica a __kcomp_prof_loop con una sola chiamata
+// all'uscita. Le tre funzioni sono definite dal runtime kruntime.cpp, che
+// accumula chiamate e cicli di clock per thread e stampa il resoconto alla
+// terminazione del programma
+GlobalVariable *driver::profileSite(StringRef Name, SourceLoc Loc, ProfileKind Kind)
+{
+  // { i32 riga, i32 tipo, [N x i8] nome }: il nome fa parte del descrittore,
+  // che resta così un'unica costante privata (anche nei moduli della cache)
+  Constant *Fields[] = {builder->getInt32(Loc.Line), builder->getInt32(Kind),
+                        ConstantDataArray::getString(*context, Name)};
+  Constant *Init = ConstantStruct::getAnon(Fields);
+  auto *Site = new GlobalVariable(*module, Init->getType(), true, GlobalValue::PrivateLinkage,
+                                  Init, "__kcomp_prof_site");
+  Site->setAlignment(Align(4));
+  ProfileSites.push_back(Site);
+  return Site;
+}
+
+FunctionCallee driver::profileHook(StringRef Name, bool Trips)
+{
+  SmallVector<Type *, 2> Params{PointerType::getUnqual(*context)};
+  if (Trips)
+    Params.push_back(builder->getInt64Ty());
+  FunctionCallee Hook = module->getOrInsertFunction(
+      Name, FunctionType::get(builder->getVoidTy(), Params, false));
+  cast<Function>(Hook.getCallee())->addFnAttr(Attribute::NoUnwind);
+  return Hook;
+}
+
+/************************* Batch *********************************/
+// Una funzione con il qualificatore batch (o ogni funzione con soli parametri
+// double, con --batch) riceve una versione che la applica a interi vettori
+//
+//   void f_batch(const double *x1, ..., const double *xk, double *out, long n)
+//
+// che calcola out[i] = f(x1[i], ..., xk[i]) per i da 0 a n-1 con un'unica
+// chiamata attraverso l'ABI C. f viene espansa nel ciclo già qui, anche a
+// -O0 e con --per-function, così che il ciclo sia vettorizzabile senza
+// dipendere dalle scelte dell'inliner. I parametri non sono noalias: out può
+// coincidere con uno degli ingressi (il vettorizzatore aggiunge i controlli
+// di sovrapposizione). Con --batch-threads si aggiunge anche
+//
+//   void f_batch_mt(const double *x1, ..., double *out, long n, long threads)
+//
+// che divide l'intervallo fra threads thread (uno per core se threads <= 0)
+// con __kcomp_parallel_for, definita dal runtime kruntime.cpp
+
+// Con -g le funzioni generate ricevono un DISubprogram artificiale alla riga
+// del prototipo di f: le istruzioni di f espanse nel ciclo devono trovarsi
+// in una funzione con informazioni di debug
+static void batchDebugInfo(driver &drv, Function *F, SourceLoc Loc)
+{
+  if (!drv.DBuilder)
+    return;
+  SmallVector<Metadata *, 8> Types{nullptr};
+  for (Argument &Arg : F->args())
+    Types.push_back(drv.debugType(Arg.getType()));
+  DISubprogram *SP = drv.DBuilder->createFunction(
+      drv.DFile, F->getName(), StringRef(), drv.DFile, Loc.Line,
+      drv.DBuilder->createSubroutineType(drv.DBuilder->getOrCreateTypeArray(Types)), Loc.Line,
+      DINode::FlagPrototyped | DINode::FlagArtificial,
+      DISubprogram::SPFlagDefinition | (drv.opts.opt_level ? DISubprogram::SPFlagOptimized : DISubprogram::SPFlagZero));
+  F->setSubprogram(SP);
+  drv.builder->SetCurrentDebugLocation(DILocation::get(*drv.context, Loc.Line, Loc.Col, SP));
+}
+
+Function *driver::emitBatch(Function *F, SourceLoc Loc)
+{
+  TimeRegion Region(*this, "batch");
+  std::string Name = (F->getName() + "_batch").str();
+  if (module->getNamedValue(Name) || (opts.batch_threads && module->getNamedValue(Name + "_mt")))
+    return (Function *)LogErrorV("Il nome " + Name + " della versione batch di " + F->getName() + " è già in uso");
+  IRBuilderBase::InsertPointGuard Guard(*builder);
+  Type *PtrTy = PointerType::getUnqual(*context);
+  Type *Int64Ty = builder->getInt64Ty();
+  Type *DoubleTy = builder->getDoubleTy();
+  unsigned K = F->arg_size();
+
+  // Ingressi, uscita e numero di elementi. I nomi dei parametri sono quelli
+  // di f (LLVM rende unici out e n se f usa gli stessi nomi) e compaiono
+  // nell'header generato con --header
+  SmallVector<Type *, 8> Params(K + 1, PtrTy);
+  Params.push_back(Int64Ty);
+  Function *B = Function::Create(FunctionType::get(builder->getVoidTy(), Params, false),
+                                 Function::ExternalLinkage, Name, *module);
+  for (unsigned j = 0; j < K; j++)
+  {
+    B->getArg(j)->setName(F->getArg(j)->getName());
+    B->addParamAttr(j, Attribute::NoCapture);
+    B->addParamAttr(j, Attribute::ReadOnly);
+  }
+  Argument *Out = B->getArg(K), *N = B->getArg(K + 1);
+  Out->setName("out");
+  B->addParamAttr(K, Attribute::NoCapture);
+  B->addParamAttr(K, Attribute::WriteOnly);
+  N->setName("n");
+  // Gli attributi fast-math di f valgono anche per il ciclo
+  for (Attribute A : F->getAttributes().getFnAttrs())
+    if (A.isStringAttribute())
+      B->addFnAttr(A);
+
+  BasicBlock *Entry = BasicBlock::Create(*context, "entry", B);
+  BasicBlock *Loop = BasicBlock::Create(*context, "loop", B);
+  BasicBlock *Exit = BasicBlock::Create(*context, "exit", B);
+  builder->SetInsertPoint(Entry);
+  batchDebugInfo(*this, B, Loc);
+  builder->CreateCondBr(builder->CreateICmpSGT(N, builder->getInt64(0), "nonempty"), Loop, Exit);
+  builder->SetInsertPoint(Loop);
+  PHINode *I = builder->CreatePHI(Int64Ty, 2, "i");
+  I->addIncoming(builder->getInt64(0), Entry);
+  SmallVector<Value *, 8> Args;
+  for (unsigned j = 0; j < K; j++)
+    Args.push_back(builder->CreateLoad(DoubleTy, builder->CreateInBoundsGEP(DoubleTy, B->getArg(j), I),
+                                       F->getArg(j)->getName()));
+  CallInst *Call = builder->CreateCall(F, Args, "val");
+  builder->CreateStore(Call, builder->CreateInBoundsGEP(DoubleTy, Out, I));
+  Value *Next = builder->CreateAdd(I, builder->getInt64(1), "next", true, true);
+  I->addIncoming(Next, Loop);
+  builder->CreateCondBr(builder->CreateICmpSLT(Next, N, "more"), Loop, Exit);
+  builder->SetInsertPoint(Exit);
+  builder->CreateRetVoid();
+  InlineFunctionInfo IFI;
+  InlineFunction(*Call, IFI);
+  if (DISubprogram *SP = B->getSubprogram())
+    DBuilder->finalizeSubprogram(SP);
+  verifyFunction(*B);
+  if (opts.opt_per_function)
+    optimize(*B);
+  if (!opts.batch_threads)
+    return B;
+
+  // f_batch_mt raccoglie i puntatori in un contesto sulla pila e lo passa,
+  // con la funzione interna f_batch.body, al runtime, che chiama
+  // f_batch.body(ctx, inizio, fine) per ogni blocco dell'intervallo
+  Type *CtxTy = ArrayType::get(PtrTy, K + 1);
+  Function *Body = Function::Create(FunctionType::get(builder->getVoidTy(), {PtrTy, Int64Ty, Int64Ty}, false),
+                                    Function::InternalLinkage, Name + ".body", *module);
+  Argument *Ctx = Body->getArg(0), *Begin = Body->getArg(1), *End = Body->getArg(2);
+  Ctx->setName("ctx");
+  Begin->setName("begin");
+  End->setName("end");
+  builder->SetInsertPoint(BasicBlock::Create(*context, "entry", Body));
+  batchDebugInfo(*this, Body, Loc);
+  Args.clear();
+  for (unsigned j = 0; j <= K; j++)
+  {
+    Value *P = builder->CreateLoad(PtrTy, builder->CreateConstInBoundsGEP2_64(CtxTy, Ctx, 0, j));
+    Args.push_back(builder->CreateInBoundsGEP(DoubleTy, P, Begin, B->getArg(j)->getName()));
+  }
+  Args.push_back(builder->CreateSub(End, Begin, "count"));
+  builder->CreateCall(B, Args);
+  builder->CreateRetVoid();
+
+  Params.push_back(Int64Ty);
+  Function *MT = Function::Create(FunctionType::get(builder->getVoidTy(), Params, false),
+                                  Function::ExternalLinkage, Name + "_mt", *module);
+  MT->setAttributes(B->getAttributes());
+  for (unsigned j = 0; j < K + 2; j++)
+    MT->getArg(j)->setName(B->getArg(j)->getName());
+  MT->getArg(K + 2)->setName("threads");
+  builder->SetInsertPoint(BasicBlock::Create(*context, "entry", MT));
+  batchDebugInfo(*this, MT, Loc);
+  AllocaInst *CtxMem = builder->CreateAlloca(CtxTy, nullptr, "ctx");
+  for (unsigned j = 0; j <= K; j++)
+    builder->CreateStore(MT->getArg(j), builder->CreateConstInBoundsGEP2_64(CtxTy, CtxMem, 0, j));
+  FunctionCallee Parallel = module->getOrInsertFunction(
+      "__kcomp_parallel_for", builder->getVoidTy(), PtrTy, PtrTy, Int64Ty, Int64Ty);
+  builder->CreateCall(Parallel, {Body, CtxMem, MT->getArg(K + 1), MT->getArg(K + 2)});
+  builder->CreateRetVoid();
+  for (Function *G : {Body, MT})
+  {
+    if (DISubprogram *SP = G->getSubprogram())
+      DBuilder->finalizeSubprogram(SP);
+    verifyFunction(*G);
+    if (opts.opt_per_function)
+      optimize(*G);
+  }
+  return B;
+}
+
+/************************* Statistics ****************************/
+// Le regioni con lo stesso nome vengono sommate; i nomi sono confrontati per
+// contenuto, perché letterali uguali di unità di traduzione diverse possono
+// avere indirizzi diversi
+void statistics::merge(const statistics &S)
+{
+  for (auto &[Name, T] : S.Timings)
+  {
+    auto It = llvm::find_if(Timings, [Name = Name](auto &E) { return !strcmp(E.first, Name); });
+    timing &Dest = It != Timings.end() ? It->second : Timings[Name];
+    Dest.Seconds += T.Seconds;
+    Dest.Count += T.Count;
+  }
+  Tokens += S.Tokens;
+  Nodes += S.Nodes;
+  for (auto &[Name, N] : S.NodeClasses)
+  {
+    auto It = llvm::find_if(NodeClasses, [Name = Name](auto &E) { return !strcmp(E.first, Name); });
+    (It != NodeClasses.end() ? It->second : NodeClasses[Name]) += N;
+  }
+  ArenaBytes += S.ArenaBytes;
+  Lookups += S.Lookups;
+  Functions += S.Functions;
+  BasicBlocks += S.BasicBlocks;
+  Instructions += S.Instructions;
+  Allocas += S.Allocas;
+  OptInstructions += S.OptInstructions;
+  CacheHits += S.CacheHits;
+  CacheMisses += S.CacheMisses;
+}
+
+// Contatori nell'ordine in cui sono stampati: nome JSON, descrizione, valore
+static std::vector<std::tuple<const char *, const char *, uint64_t>> counters(const statistics &S)
+{
+  return {{"tokens", "token", S.Tokens},
+          {"ast_nodes", "nodi AST", S.Nodes},
+          {"ast_bytes", "byte allocati per l'AST", S.ArenaBytes},
+          {"symbol_lookups", "ricerche di simboli", S.Lookups},
+          {"functions", "funzioni generate", S.Functions},
+          {"basic_blocks", "blocchi di base", S.BasicBlocks},
+          {"instructions", "istruzioni generate", S.Instructions},
+          {"allocas", "istruzioni alloca", S.Allocas},
+          {"instructions_optimized", "istruzioni dopo l'ottimizzazione", S.OptInstructions},
+          {"cache_hits", "successi della cache", S.CacheHits},
+          {"cache_misses", "fallimenti della cache", S.CacheMisses}};
+}
+
+// Le regioni sono elencate in ordine di tempo decrescente, come in
+// -ftime-report di clang
+void statistics::print(raw_ostream &OS) const
+{
+  std::vector<std::pair<const char *, timing>> Sorted(Timings.begin(), Timings.end());
+  llvm::sort(Sorted, [](auto &A, auto &B) { return A.second.Seconds > B.second.Seconds; });
+  double Total = 0;
+  for (auto &E : Sorted)
+    Total += E.second.Seconds;
+  OS << "===-------------------------------------------------------------------===\n"
+     << "                        kcomp: tempi di compilazione\n"
+     << "===-------------------------------------------------------------------===\n"
+     << "   Tempo (s)       %       Volte  Regione\n";
+  for (auto &[Name, T] : Sorted)
+    OS << format("  %10.6f  %5.1f%%  %10llu  %s\n", T.Seconds, Total > 0 ? 100 * T.Seconds / Total : 0.0,
+                 (unsigned long long)T.Count, Name);
+  OS << format("  %10.6f  100.0%%              Totale\n\n", Total);
+  for (auto &[Key, Desc, Value] : counters(*this))
+    OS << format("  %12llu  %s\n", (unsigned long long)Value, Desc);
+  std::vector<std::pair<const char *, uint64_t>> Classes(NodeClasses.begin(), NodeClasses.end());
+  llvm::sort(Classes, [](auto &A, auto &B) { return A.second > B.second; });
+  for (auto &[Name, N] : Classes)
+    OS << format("  %12llu    nodi %s\n", (unsigned long long)N, Name);
+}
+
+void statistics::printJSON(raw_ostream &OS) const
+{
+  OS << "{\n  \"timers\": {";
+  bool First = true;
+  for (auto &[Name, T] : Timings)
+  {
+    OS << (First ? "\n" : ",\n") << "    \"" << Name << "\": {\"seconds\": "
+       << format("%.9f", T.Seconds) << ", \"count\": " << T.Count << "}";
+    First = false;
+  }
+  OS << "\n  },\n  \"counters\": {";
+  First = true;
+  for (auto &[Key, Desc, Value] : counters(*this))
+  {
+    OS << (First ? "\n" : ",\n") << "    \"" << Key << "\": " << Value;
+    First = false;
+  }
+  OS << "\n  },\n  \"ast_node_classes\": {";
+  First = true;
+  for (auto &[Name, N] : NodeClasses)
+  {
+    OS << (First ? "\n" : ",\n") << "    \"" << Name << "\": " << N;
+    First = false;
+  }
+  OS << "\n  }\n}\n";
+}
+
+/************************* Symbol table ****************************/
+// Gli identificatori sono internati: tutte le occorrenze di un nome sono
+// rappresentate dalla stessa StringRef, quella della prima occorrenza. Se il
+// sorgente è mappato in memoria si tratta di una vista nella mappatura (che
+// resta valida fino al termine dell'analisi), altrimenti di una copia
+StringRef driver::intern(StringRef Id)
+{
+  auto It = identifiers.find(Id);
+  if (It != identifiers.end())
+    return *It;
+  if (!input)
+    Id = StringSaver(strarena).save(Id);
+  identifiers.insert(Id);
+  return Id;
+}
+
+// Registra Name nello scope corrente con un nuovo slot. Name deve essere un
+// identificatore internato (tutti quelli prodotti dallo scanner lo sono), perché
+// la tabella confronta i puntatori e non il contenuto delle stringhe
+// Una variabile inizializzata è candidata a diventare intera: lo resterà se
+// è una variabile di induzione o un temporaneo intero (si veda inferTypes)
+unsigned driver::declare(StringRef Name, ExprAST *Init)
+{
+  unsigned Slot = SlotTypes.size();
+  SlotTypes.push_back(Init ? Type::getInt64Ty(*context) : Type::getDoubleTy(*context));
+  Symbols.insert(Name.data(), Slot);
+  if (Init)
+    Assignments.emplace_back(Slot, Init, true);
+  return Slot;
+}
+
+// Lo slot di un array ha tipo ptr, qualunque sia la sua allocazione
+unsigned driver::declareArray(StringRef Name)
+{
+  unsigned Slot = declare(Name);
+  SlotTypes[Slot] = PointerType::getUnqual(*context);
+  return Slot;
+}
+
+// Il tipo di un parametro vettoriale è fissato dal prototipo
+unsigned driver::declareVector(StringRef Name, unsigned Width)
+{
+  unsigned Slot = declare(Name);
+  SlotTypes[Slot] = FixedVectorType::get(Type::getDoubleTy(*context), Width);
+  return Slot;
+}
+
+bool driver::isArray(const VarRef &Ref)
+{
+  if (Ref.Global)
+    return Ref.Global->getValueType()->isArrayTy();
+  return SlotTypes[Ref.Slot]->isPointerTy();
+}
+
+// Lega un riferimento alla variabile locale visibile con quel nome oppure,
+// in mancanza, alla variabile globale omonima
+bool driver::resolve(StringRef Name, VarRef &Ref)
+{
+  Stats.Lookups++;
+  if (Symbols.count(Name.data()))
+  {
+    Ref.Slot = Symbols.lookup(Name.data());
+    return true;
+  }
+  auto G = Globals.find(Name.data());
+  if (G != Globals.end())
+  {
+    Ref.Global = G->second;
+    return true;
+  }
+  LogErrorV("Variabile " + Name + " non definita");
+  return false;
+}
+
+void driver::assign(const VarRef &Ref, ExprAST *Val)
+{
+  if (!Ref.Global)
+    Assignments.emplace_back(Ref.Slot, Val, false);
+}
+
+// Deduzione dei tipi al termine della risoluzione di una funzione. Sono i64
+// solo le variabili di induzione (valore iniziale intero, poi soltanto
+// x = x ± c con c costante intera, come ++i) e i temporanei inizializzati
+// con un valore intero e mai riassegnati (ad esempio var j = i + 1, usato come
+// indice). Ogni altra variabile resta double: x = x + x, calcolato in i64,
+// traboccherebbe dove il double perde soltanto precisione. Si parte
+// assumendo intere tutte le variabili candidate e si declassa a double ogni
+// variabile che non rispetta la regola; poiché declassare una variabile può
+// rendere non interi altri valori, si ripete fino al punto fisso.
+// I contatori dei cicli (var i = 0 ... ++i) restano così i64 e il ciclo è
+// riconosciuto da SCEV, dunque vettorizzabile e srotolabile.
+// Prima ancora, le variabili cui è assegnato un vettore diventano vettori
+// della stessa larghezza (anche questo fino al punto fisso, perché il valore
+// di una variabile può dipendere da altre). I primi Params slot sono i
+// parametri, il cui tipo è dato dal prototipo
+void driver::inferTypes(unsigned Params)
+{
+  bool changed = true;
+  while (changed)
+  {
+    changed = false;
+    for (auto &[Slot, Val, Init] : Assignments)
+      if (Slot >= Params && !SlotTypes[Slot]->isVectorTy())
+        if (unsigned Width = Val->vectorWidth(*this))
+        {
+          SlotTypes[Slot] = FixedVectorType::get(Type::getDoubleTy(*context), Width);
+          changed = true;
+        }
+  }
+  changed = true;
+  while (changed)
+  {
+    changed = false;
+    for (auto &[Slot, Val, Init] : Assignments)
+      if (SlotTypes[Slot]->isIntegerTy() && !(Init ? Val->isInteger(*this) : Val->isStep(Slot)))
+      {
+        SlotTypes[Slot] = Type::getDoubleTy(*context);
+        changed = true;
+      }
+  }
+  Assignments.clear();
+}
+
+// Un array locale di dimensione costante è l'alloca stessa; i parametri
+// array e gli array sul heap hanno invece uno slot che ne contiene l'indirizzo
+Value *driver::address(const VarRef &Ref)
+{
+  if (Ref.Global)
+    return Ref.Global;
+  AllocaInst *A = Slots[Ref.Slot];
+  if (A->getAllocatedType()->isPointerTy())
+    return builder->CreateLoad(A->getAllocatedType(), A, A->getName());
+  return A;
+}
+
+// free è già stata dichiarata (con il tipo corretto) da ArrayBindingAST::codegen
+// quando il primo array è stato allocato sul heap
+void driver::emitCleanups(size_t From)
+{
+  for (size_t i = Cleanups.size(); i > From; i--)
+    builder->CreateCall(module->getFunction("free"), Cleanups[i - 1]);
+}
+
+// Funzioni della libreria C chiamate dal codice generato. Il programma può
+// averne definita o dichiarata una omonima, ma con un altro tipo (ad esempio
+// extern free(x), che riceve un double): la chiamata sarebbe sbagliata e
+// viene dunque segnalata come errore
+Function *driver::libFunction(StringRef Name, FunctionType *FT)
+{
+  Function *F = module->getFunction(Name);
+  if (!F)
+    return Function::Create(FT, Function::ExternalLinkage, Name, *module);
+  if (F->getFunctionType() == FT)
+    return F;
+  LogErrorV("La funzione " + Name + " del programma nasconde quella della libreria C, usata per gli array sul heap");
+  return nullptr;
+}
+
+/************************* Target machine **************************/
+static std::optional<Reloc::Model> getRelocModel(const std::string &name)
+{
+  if (name == "static")
+    return Reloc::Static;
+  if (name == "pic")
+    return Reloc::PIC_;
+  if (name == "dynamic-no-pic")
+    return Reloc::DynamicNoPIC;
+  return std::nullopt;
+}
+
+static std::optional<CodeModel::Model> getCodeModel(const std::string &name)
+{
+  if (name == "tiny")
+    return CodeModel::Tiny;
+  if (name == "small")
+    return CodeModel::Small;
+  if (name == "kernel")
+    return CodeModel::Kernel;
+  if (name == "medium")
+    return CodeModel::Medium;
+  if (name == "large")
+    return CodeModel::Large;
+  return std::nullopt;
+}
+
+// Crea la TargetMachine per l'host. Con -mcpu=native vengono usate la CPU e
+// le feature rilevate sulla macchina corrente (AVX2, AVX-512, ...), così che
+// vettorizzatori e backend possano sfruttarle. In assenza di indicazioni il
+// modello di rilocazione è PIC, come per clang, in modo da poter linkare
+// l'oggetto in un eseguibile PIE
+static TargetMachine *createTargetMachine(const driver &drv)
+{
+  std::string triple = sys::getDefaultTargetTriple();
+  std::string error;
+  const Target *target = TargetRegistry::lookupTarget(triple, error);
+  if (!target)
+  {
+    std::cerr << error << std::endl;
+    return nullptr;
+  }
+
+  // In modalità JIT il codice viene eseguito sulla macchina stessa e dunque,
+  // salvo diversa indicazione, viene specializzato per l'host
+  std::string cpu = !drv.opts.mcpu.empty() ? drv.opts.mcpu : drv.opts.jit ? "native" : "generic";
+  std::string features;
+  if (cpu == "native")
+  {
+    cpu = sys::getHostCPUName().str();
+    StringMap<bool> hostFeatures;
+    if (sys::getHostCPUFeatures(hostFeatures))
+      for (auto &F : hostFeatures)
+        features += (features.empty() ? "" : ",") + std::string(F.second ? "+" : "-") + F.first().str();
+  }
+
+  std::optional<Reloc::Model> RM = Reloc::PIC_;
+  if (!drv.opts.reloc_model.empty() && !(RM = getRelocModel(drv.opts.reloc_model)))
+  {
+    std::cerr << "modello di rilocazione non valido: " << drv.opts.reloc_model << std::endl;
+    return nullptr;
+  }
+  std::optional<CodeModel::Model> CM;
+  if (!drv.opts.code_model.empty() && !(CM = getCodeModel(drv.opts.code_model)))
+  {
+    std::cerr << "modello di codice non valido: " << drv.opts.code_model << std::endl;
+    return nullptr;
+  }
+
+  CodeGenOpt::Level level = drv.opts.opt_level == 0   ? CodeGenOpt::None
+                            : drv.opts.opt_level == 1 ? CodeGenOpt::Less
+                            : drv.opts.opt_level == 2 ? CodeGenOpt::Default
+                                                 : CodeGenOpt::Aggressive;
+  return target->createTargetMachine(triple, cpu, features, TargetOptions(), RM, CM, level);
+}
+
+static std::optional<PGOOptions> getPGOOptions(const options &opts); // Sezione Optimization
+
+// Implementazione del metodo parse. Il codice di ogni definizione di primo
+// livello viene generato non appena il parser la riconosce (si veda il
+// metodo codegen(RootAST*)), quindi prima di iniziare vanno predisposti
+// il target e il modulo. Triple e data layout sono impostati prima della
+// generazione, così che anche le ottimizzazioni conoscano la macchina di destinazione
+int driver::parse(const std::string &f)
+{
+  file = f;                              // File con il programma
+  CurrentFile = file;
+  location.initialize(&file);            // Inizializzazione dell'oggetto location
+  target.reset(createTargetMachine(*this));
+  if (!target)
+    return 1;
+  module->setSourceFileName(file);
+  module->setTargetTriple(target->getTargetTriple().str());
+  module->setDataLayout(target->createDataLayout());
+  if (opts.debug_info)
+  {
+    SmallString<128> Dir(file);
+    sys::fs::make_absolute(Dir);
+    sys::path::remove_filename(Dir);
+    module->addModuleFlag(Module::Warning, "Debug Info Version", DEBUG_METADATA_VERSION);
+    module->addModuleFlag(Module::Warning, "Dwarf Version", 5);
+    DBuilder = std::make_unique<DIBuilder>(*module);
+    DFile = DBuilder->createFile(sys::path::filename(file), Dir);
+    DUnit = DBuilder->createCompileUnit(dwarf::DW_LANG_C, DFile, "kcomp", opts.opt_level > 0, "", 0);
+  }
+  optimizer = std::make_unique<passes>(opts.opt_level, target.get(), getPGOOptions(opts));
+  if (!opts.cache_dir.empty())
+    initCache();
+  TimeRegion Region(*this, "parser");         // Comprende scanner e generazione del codice
+  if (!scan_begin())                     // Inizio scanning (ovvero apertura del file programma)
+    return 1;
+  yy::parser parser(*this);              // Istanziazione del parser
+  parser.set_debug_level(opts.trace_parsing); // Livello di debug del parsed
+  int res = parser.parse();              // Chiamata dell'entry point del parser
+  releaseAST();                          // Nodi di una definizione con errori di sintassi
+  scan_end();                            // Fine scanning (ovvero chiusura del file programma)
+  return res;
+}
+
+// Generazione del codice di una definizione di primo livello (funzione,
+// extern o variabile globale), chiamata dal parser non appena la riconosce.
+// In questo modo non è mai necessario costruire (e poi visitare ricorsivamente)
+// l'AST dell'intero file e la memoria occupata dall'AST è limitata a quella
+// della definizione più grande
+void driver::codegen(RootAST *top)
+{
+  // I nodi creati durante la generazione (dalla semplificazione) non hanno
+  // una posizione propria e usano quella del nodo in corso di generazione
+  RootAST::NextLoc = SourceLoc();
+  top->codegen(*this);
+  // L'AST della definizione non serve più: la memoria dei suoi nodi
+  // viene rilasciata in blocco (e riutilizzata per la definizione successiva)
+  releaseAST();
+};
+
+// Prima del rilascio i nodi sono contati per classe: non sono mai distrutti,
+// dunque il loro className resta disponibile fino al Reset dell'arena
+void driver::releaseAST()
+{
+  for (RootAST *N : NewNodes)
+    Stats.NodeClasses[N->className()]++;
+  NewNodes.clear();
+  Stats.ArenaBytes += arena.getBytesAllocated();
+  arena.Reset();
+}
+
+// Implementazione del metodo codegen: terminato il parsing (e dunque la
+// generazione di tutte le definizioni), il modulo viene ottimizzato (se non
+// lo è già stata ogni singola funzione) ed emesso (o eseguito, in modalità JIT)
+int driver::codegen()
+{
+  if (DBuilder)
+    DBuilder->finalize();
+  if (!opts.header.empty() && writeHeader())
+    return 1;
+  optimize();
+  if (Stats.Enabled)
+    for (Function &F : *module)
+      Stats.OptInstructions += F.getInstructionCount();
+  return opts.jit ? execute() : emit();
+};
+
+/************************* Emission **************************/
+// Senza --emit e senza -o il modulo viene stampato in forma testuale su stderr,
+// come nelle versioni precedenti (con -j viene invece raccolto in listing, per
+// non mescolare l'output di file diversi). Altrimenti il formato è quello richiesto
+// (o dedotto dall'estensione del file di uscita) e oggetti e assembly sono
+// prodotti direttamente dalla TargetMachine, senza passare per llvm-as, llc e as
+int driver::emit()
+{
+  TimeRegion Region(*this, "emit");
+  if (opts.emit_kind.empty() && opts.output.empty())
+  {
+    if (opts.jobs > 1)
+    {
+      raw_string_ostream OS(listing);
+      module->print(OS, nullptr);
+    }
+    else
+      module->print(errs(), nullptr);
+    return 0;
+  }
+
+  std::string kind = opts.emit_kind;
+  if (kind.empty())
+  {
+    StringRef ext = sys::path::extension(opts.output);
+    kind = ext == ".s" ? "asm" : ext == ".bc" ? "bc" : ext == ".ll" ? "ll" : "obj";
+  }
+  if (kind != "obj" && kind != "asm" && kind != "bc" && kind != "ll")
+  {
+    std::cerr << "formato di uscita non valido: " << kind << std::endl;
+    return 1;
+  }
+
+  std::string out = opts.output;
+  if (out.empty())
+  {
+    SmallString<128> path(file);
+    sys::path::replace_extension(path, kind == "obj" ? "o" : kind == "asm" ? "s" : kind);
+    out = std::string(path);
+  }
+
+  std::error_code EC;
+  bool text = kind == "asm" || kind == "ll";
+  raw_fd_ostream dest(out, EC, text ? sys::fs::OF_Text : sys::fs::OF_None);
+  if (EC)
+  {
+    std::cerr << "impossibile aprire " << out << ": " << EC.message() << std::endl;
+    return 1;
+  }
+
+  if (kind == "ll")
+    module->print(dest, nullptr);
+  else if (kind == "bc")
+    WriteBitcodeToFile(*module, dest);
+  else
+  {
+    legacy::PassManager pass;
+    CodeGenFileType type = kind == "obj" ? CGFT_ObjectFile : CGFT_AssemblyFile;
+    if (target->addPassesToEmitFile(pass, dest, nullptr, type))
+    {
+      std::cerr << "il target non supporta l'emissione di " << kind << std::endl;
+      return 1;
+    }
+    pass.run(*module);
+  }
+  dest.flush();
+  return 0;
+}
+
+// Con --header=file.h si scrive anche un header C che dichiara le funzioni
+// e le variabili globali definite nel modulo, comprese le versioni batch, da
+// includere nel codice C o C++ che le chiama. L'header è scritto prima
+// dell'ottimizzazione: i soli parametri readonly sono allora gli ingressi
+// delle funzioni batch, dichiarati const double *. I tipi vec2, vec4 e vec8
+// diventano vettori di GCC e clang (vector_size): passati per valore, quelli
+// più larghi di 16 byte seguono la convenzione di chiamata del C solo se il
+// chiamante è compilato con le stesse estensioni vettoriali (-mavx, -mavx512f)
+// scelte per kcomp con -mcpu
+int driver::writeHeader()
+{
+  std::error_code EC;
+  raw_fd_ostream OS(opts.header, EC, sys::fs::OF_Text);
+  if (EC)
+  {
+    std::cerr << "impossibile aprire " << opts.header << ": " << EC.message() << std::endl;
+    return 1;
+  }
+  std::string Guard = "KCOMP_";
+  for (char c : sys::path::filename(opts.header))
+    Guard += isAlnum(c) ? toUpper(c) : '_';
+  OS << "/* Generato da kcomp a partire da " << sys::path::filename(file) << " */\n"
+     << "#ifndef " << Guard << "\n#define " << Guard << "\n\n"
+     << "#ifdef __cplusplus\nextern \"C\" {\n#endif\n\n";
+  auto CType = [](Type *T) -> std::string {
+    if (auto *VT = dyn_cast<FixedVectorType>(T))
+      return "kcomp_vec" + std::to_string(VT->getNumElements()) + " ";
+    return T->isVoidTy() ? "void " : T->isIntegerTy() ? "long " : "double ";
+  };
+  if (any_of(*module, [](Function &F) {
+        return F.getReturnType()->isVectorTy() || any_of(F.args(), [](Argument &A) { return A.getType()->isVectorTy(); });
+      }))
+  {
+    for (unsigned Width : {2, 4, 8})
+      OS << "typedef double kcomp_vec" << Width << " __attribute__((vector_size(" << 8 * Width << ")));\n";
+    OS << "\n";
+  }
+  for (GlobalVariable &G : module->globals())
+  {
+    if (G.hasLocalLinkage() || G.isDeclaration())
+      continue;
+    OS << "extern double " << G.getName();
+    if (auto *AT = dyn_cast<ArrayType>(G.getValueType()))
+      OS << "[" << AT->getNumElements() << "]";
+    OS << ";\n";
+  }
+  for (Function &F : *module)
+  {
+    if (F.hasLocalLinkage() || F.isDeclaration())
+      continue;
+    OS << CType(F.getReturnType()) << F.getName() << "(";
+    for (Argument &Arg : F.args())
+    {
+      OS << (Arg.getArgNo() ? ", " : "");
+      if (!Arg.getType()->isPointerTy())
+        OS << CType(Arg.getType());
+      else
+        OS << (Arg.hasAttribute(Attribute::ReadOnly) ? "const double *" : "double *");
+      OS << Arg.getName();
+      Attribute Length = F.getAttributes().getParamAttr(Arg.getArgNo(), "kcomp-length");
+      unsigned L;
+      if (Length.isValid() && !Length.getValueAsString().getAsInteger(10, L))
+        OS << " /* [" << F.getArg(L)->getName() << "] */";
+    }
+    OS << (F.arg_empty() ? "void);\n" : ");\n");
+  }
+  OS << "\n#ifdef __cplusplus\n}\n#endif\n\n#endif\n";
+  return 0;
+}
+
+/************************* JIT execution **************************/
+// Il modulo viene compilato in memoria da ORC LLJIT ed eseguito subito.
+// Per poter chiamare la funzione di ingresso (con un numero arbitrario di
+// argomenti double) viene aggiunta al modulo una funzione senza parametri
+// che la invoca con gli argomenti costanti passati sulla linea di comando.
+// I simboli non definiti nel modulo (ad esempio extern floor(x)) sono cercati
+// nel processo kcomp stesso e nelle librerie indicate con -l
+int driver::execute()
+{
+  TimeRegion Region(*this, "jit");
+  Function *entry = module->getFunction(opts.jit_entry);
+  if (!entry || entry->isDeclaration())
+  {
+    std::cerr << "funzione di ingresso " << opts.jit_entry << " non definita" << std::endl;
+    return 1;
+  }
+  if (entry->arg_size() != opts.jit_args.size())
+  {
+    std::cerr << "la funzione " << opts.jit_entry << " richiede " << entry->arg_size() << " argomenti" << std::endl;
+    return 1;
+  }
+  if (!entry->getReturnType()->isDoubleTy() ||
+      any_of(entry->args(), [](Argument &A) { return !A.getType()->isDoubleTy(); }))
+  {
+    std::cerr << "la funzione di ingresso " << opts.jit_entry << " deve avere parametri e risultato double" << std::endl;
+    return 1;
+  }
+  Function *thunk = Function::Create(FunctionType::get(Type::getDoubleTy(*context), false),
+                                     Function::ExternalLinkage, "__kcomp_jit_entry", *module);
+  IRBuilder<> B(BasicBlock::Create(*context, "entry", thunk));
+  std::vector<Value *> ArgsV;
+  for (double arg : opts.jit_args)
+    ArgsV.push_back(ConstantFP::get(*context, APFloat(arg)));
+  B.CreateRet(B.CreateCall(entry, ArgsV));
+
+  auto J = orc::LLJITBuilder().create();
+  if (!J)
+  {
+    logAllUnhandledErrors(J.takeError(), errs(), "kcomp: ");
+    return 1;
+  }
+  orc::JITDylib &JD = (*J)->getMainJITDylib();
+  char prefix = (*J)->getDataLayout().getGlobalPrefix();
+  JD.addGenerator(cantFail(orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(prefix)));
+  for (auto &lib : opts.jit_libs)
+  {
+    auto G = orc::DynamicLibrarySearchGenerator::Load(lib.c_str(), prefix);
+    if (!G)
+    {
+      logAllUnhandledErrors(G.takeError(), errs(), "kcomp: ");
+      return 1;
+    }
+    JD.addGenerator(std::move(*G));
+  }
+
+  // Il JIT prende possesso del modulo e del contesto del driver
+  optimizer.reset();
+  builder.reset();
+  orc::ThreadSafeModule TSM(std::move(module), std::move(context));
+  if (auto Err = (*J)->addIRModule(std::move(TSM)))
+  {
+    logAllUnhandledErrors(std::move(Err), errs(), "kcomp: ");
+    return 1;
+  }
+
+  auto Sym = (*J)->lookup("__kcomp_jit_entry");
+  if (!Sym)
+  {
+    logAllUnhandledErrors(Sym.takeError(), errs(), "kcomp: ");
+    return 1;
+  }
+  double (*run)() = Sym->toPtr<double (*)()>();
+  double result = run();
+  std::cout << opts.jit_entry << " = " << result << std::endl;
+  // Con --instrument il runtime legge i descrittori dei siti, che sono nella
+  // memoria del JIT, alla terminazione del processo: il JIT non va distrutto
+  if (opts.instrument)
+    J->release();
+  return 0;
+}
+
+/************************* Optimization **************************/
+static OptimizationLevel getOptLevel(int level)
+{
+  switch (level)
+  {
+  case 1:
+    return OptimizationLevel::O1;
+  case 2:
+    return OptimizationLevel::O2;
+  case 3:
+    return OptimizationLevel::O3;
+  default:
+    return OptimizationLevel::O0;
+  }
+}
+
+// Il PassBuilder registra tutte le analisi nei rispettivi gestori e li collega
+// fra loro (proxy), dopodiché costruisce le pipeline standard del livello
+// richiesto, ovvero le stesse usate da clang. Come in clang, la vettorizzazione
+// dei cicli e quella SLP sono abilitate solo da -O2 in su. La TargetMachine
+// fornisce ai passi il modello dei costi del target (TargetTransformInfo).
+// Le opzioni PGO aggiungono alle pipeline la strumentazione o la lettura del
+// profilo (si veda getPGOOptions)
+passes::passes(int level, TargetMachine *TM, std::optional<PGOOptions> PGO) : PB(TM, [level] {
+                              PipelineTuningOptions PTO;
+                              PTO.LoopVectorization = level > 1;
+                              PTO.SLPVectorization = level > 1;
+                              return PTO;
+                            }(), PGO, &PIC)
+{
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  OptimizationLevel Level = getOptLevel(level);
+  if (Level == OptimizationLevel::O0)
+    MPM = PB.buildO0DefaultPipeline(Level);
+  else
+  {
+    // La pipeline per funzione è quella di semplificazione (mem2reg, instcombine,
+    // GVN, LICM, passi sui cicli, ...) ed è pensata per iterazioni rapide.
+    // A -O0 resta vuota
+    FPM = PB.buildFunctionSimplificationPipeline(Level, ThinOrFullLTOPhase::None);
+    MPM = PB.buildPerModuleDefaultPipeline(Level);
+  }
+}
+
+// Profile-guided optimization a livello di IR, come -fprofile-generate e
+// -fprofile-use di clang. Con -fprofile-generate la pipeline inserisce un
+// contatore per ogni arco non ricostruibile del grafo di controllo (compresi
+// i rami di if, espressioni condizionali, operatori logici e cicli) e il
+// programma, collegato con il runtime di profilo di compiler-rt (clang
+// -fprofile-generate), scrive il profilo grezzo alla terminazione. Il
+// profilo, indicizzato con llvm-profdata merge, è letto con -fprofile-use:
+// i contatori diventano pesi (branch_weights) dei salti condizionali e
+// conteggi di ingresso delle funzioni, e il riepilogo del profilo permette
+// all'inliner di distinguere le chiamate calde da quelle fredde. Il profilo
+// è associato alle funzioni per nome e per hash del grafo di controllo, che
+// deve quindi essere generato con lo stesso livello di ottimizzazione
+static std::optional<PGOOptions> getPGOOptions(const options &opts)
+{
+  if (opts.profile_generate)
+    return PGOOptions(opts.profile_raw, "", "", "", vfs::getRealFileSystem(), PGOOptions::IRInstr);
+  if (!opts.profile_use.empty())
+    return PGOOptions(opts.profile_use, "", "", "", vfs::getRealFileSystem(), PGOOptions::IRUse);
+  return std::nullopt;
+}
+
+// La pipeline viene stampata come commento IR, così che l'output su stderr
+// resti un modulo valido per llvm-as. Il formato è quello accettato da opt -passes=
+template <typename PassManagerT>
+static void printPipeline(PassManagerT &PM, PassInstrumentationCallbacks &PIC)
+{
+  std::string pipeline;
+  raw_string_ostream OS(pipeline);
+  PM.printPipeline(OS, [&PIC](StringRef ClassName)
+                   {
+    StringRef PassName = PIC.getPassNameForClassName(ClassName);
+    return PassName.empty() ? ClassName : PassName; });
+  errs() << "; pipeline: " << OS.str() << "\n";
+}
+
+void driver::optimize(Function &F)
+{
+  TimeRegion Region(*this, "optimize function");
+  optimizer->FPM.run(F, optimizer->FAM);
+}
+
+void driver::optimize()
+{
+  if (opts.print_pipeline)
+  {
+    if (opts.opt_per_function)
+      printPipeline(optimizer->FPM, optimizer->PIC);
+    else
+      printPipeline(optimizer->MPM, optimizer->PIC);
+  }
+  if (!opts.opt_per_function)
+  {
+    TimeRegion Region(*this, "optimize module");
+    optimizer->MPM.run(*module, optimizer->MAM);
+  }
+}
+
+/************************* Function cache **************************/
+// Con --cache-dir il codice di ogni funzione (ottimizzato: a -O1 e oltre la
+// cache richiede --per-function) viene salvato in un file bitcode della
+// directory indicata, il cui nome è l'hash MD5 della funzione: quello del suo
+// AST, dopo risoluzione dei nomi e semplificazione, con le funzioni e le
+// variabili globali a cui fa riferimento, preceduto dall'hash di compilatore,
+// target e opzioni.
+// Se il file esiste già, la generazione del codice e l'ottimizzazione della
+// funzione sono sostituite dal collegamento (Linker) del file al modulo
+
+// I valori sono aggiunti all'hash nella loro rappresentazione binaria,
+// le stringhe seguite da un terminatore
+static void hashValue(MD5 &H, uint64_t V)
+{
+  H.update(ArrayRef<uint8_t>(reinterpret_cast<const uint8_t *>(&V), sizeof(V)));
+}
+
+static void hashValue(MD5 &H, StringRef S)
+{
+  H.update(S);
+  H.update(ArrayRef<uint8_t>(uint8_t(0)));
+}
+
+static void hashValue(MD5 &H, FastMathFlags FMF)
+{
+  hashValue(H, FMF.allowReassoc() | FMF.noNaNs() << 1 | FMF.noInfs() << 2 |
+                   FMF.noSignedZeros() << 3 | FMF.allowReciprocal() << 4 |
+                   FMF.allowContract() << 5 | FMF.approxFunc() << 6);
+}
+
+// Un riferimento a una variabile globale dipende dal suo nome e dal suo tipo
+// (double o array), uno a una variabile locale soltanto dal suo slot
+static void hashValue(MD5 &H, const VarRef &Ref)
+{
+  hashValue(H, Ref.Slot);
+  if (Ref.Global)
+  {
+    hashValue(H, Ref.Global->getName());
+    Type *T = Ref.Global->getValueType();
+    hashValue(H, T->isArrayTy() ? T->getArrayNumElements() : 0);
+  }
+}
+
+// Il salt vale per tutte le funzioni del file; la directory viene creata se
+// non esiste
+void driver::initCache()
+{
+  MD5 H;
+  hashValue(H, "kcomp " LLVM_VERSION_STRING);
+  hashValue(H, module->getTargetTriple());
+  hashValue(H, module->getDataLayoutStr());
+  hashValue(H, target->getTargetCPU());
+  hashValue(H, target->getTargetFeatureString());
+  hashValue(H, opts.opt_level);
+  hashValue(H, opts.opt_per_function);
+  hashValue(H, opts.reloc_model);
+  hashValue(H, opts.code_model);
+  hashValue(H, opts.builtins);
+  hashValue(H, opts.debug_info);
+  hashValue(H, opts.instrument);
+  hashValue(H, opts.instrument_loops);
+  if (opts.debug_info)
+    hashValue(H, module->getSourceFileName());
+  for (const std::string &N : opts.no_builtins)
+    hashValue(H, N);
+  MD5::MD5Result Salt;
+  H.final(Salt);
+  CacheSalt = Salt.digest().str();
+  sys::fs::create_directories(opts.cache_dir);
+}
+
+std::string driver::cachePath(MD5 &H)
+{
+  MD5::MD5Result Key;
+  H.final(Key);
+  SmallString<128> Path(opts.cache_dir);
+  sys::path::append(Path, Key.digest());
+  Path += ".bc";
+  return std::string(Path);
+}
+
+// Un file illeggibile o non valido (ad esempio troncato) è un fallimento
+// della cache: la funzione viene compilata e il file riscritto.
+// Con -g il modulo in cache porta con sé una copia dell'unità di compilazione:
+// i suoi DISubprogram sono riassegnati a quella del modulo (DUnit) e la copia
+// è eliminata, altrimenti ogni successo aggiungerebbe un'unità a llvm.dbg.cu
+bool driver::cacheLoad(const std::string &Path)
+{
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buf = MemoryBuffer::getFile(Path);
+  if (Buf)
+  {
+    Expected<std::unique_ptr<Module>> M = parseBitcodeFile(**Buf, *context);
+    if (!M)
+      consumeError(M.takeError());
+    else
+    {
+      if (DUnit)
+      {
+        DebugInfoFinder Finder;
+        Finder.processModule(**M);
+        for (DISubprogram *SP : Finder.subprograms())
+          if (SP->getUnit())
+            SP->replaceUnit(DUnit);
+        if (NamedMDNode *CUs = (*M)->getNamedMetadata("llvm.dbg.cu"))
+          (*M)->eraseNamedMetadata(CUs);
+      }
+      if (!Linker::linkModules(*module, std::move(*M)))
+      {
+        Stats.CacheHits++;
+        return true;
+      }
+    }
+  }
+  Stats.CacheMisses++;
+  return false;
+}
+
+// Dichiara in M le funzioni e le variabili globali usate da V
+static void declareGlobals(Module &M, Value *V, ValueToValueMapTy &VMap)
+{
+  if (auto *GV = dyn_cast<GlobalValue>(V))
+  {
+    if (VMap.count(GV))
+      return;
+    if (auto *F = dyn_cast<Function>(GV))
+    {
+      Function *Decl = Function::Create(F->getFunctionType(), GlobalValue::ExternalLinkage, F->getName(), M);
+      Decl->setAttributes(F->getAttributes());
+      VMap[F] = Decl;
+    }
+    else if (auto *G = dyn_cast<GlobalVariable>(GV))
+    {
+      // Le costanti private (i descrittori di --instrument) non sono
+      // visibili dal modulo che caricherà la funzione: vanno copiate
+      bool Local = G->hasLocalLinkage() && G->hasInitializer();
+      auto *NewG = new GlobalVariable(M, G->getValueType(), G->isConstant(),
+                                      Local ? G->getLinkage() : GlobalValue::ExternalLinkage,
+                                      Local ? G->getInitializer() : nullptr, G->getName());
+      NewG->setAlignment(G->getAlign());
+      VMap[G] = NewG;
+    }
+  }
+  else if (auto *CE = dyn_cast<ConstantExpr>(V))
+    for (Value *Op : CE->operands())
+      declareGlobals(M, Op, VMap);
+}
+
+// Il file contiene un modulo con la sola funzione F e le dichiarazioni di ciò
+// che usa. Viene scritto in un file temporaneo e poi rinominato: un altro
+// processo kcomp che usa la stessa cache vede il file completo oppure nessun
+// file. Gli errori non sono segnalati: la funzione resta semplicemente fuori
+// dalla cache
+void driver::cacheStore(const std::string &Path, Function &F)
+{
+  Module M(module->getModuleIdentifier(), *context);
+  M.setTargetTriple(module->getTargetTriple());
+  M.setDataLayout(module->getDataLayout());
+  // Con -g il modulo deve dichiarare la versione dei metadati di debug,
+  // altrimenti alla lettura le informazioni di debug sarebbero scartate
+  SmallVector<Module::ModuleFlagEntry> Flags;
+  module->getModuleFlagsMetadata(Flags);
+  for (const Module::ModuleFlagEntry &Flag : Flags)
+    M.addModuleFlag(Flag.Behavior, Flag.Key->getString(), Flag.Val);
+  ValueToValueMapTy VMap;
+  Function *NewF = Function::Create(F.getFunctionType(), F.getLinkage(), F.getName(), M);
+  VMap[&F] = NewF;
+  auto NewArg = NewF->arg_begin();
+  for (Argument &Arg : F.args())
+  {
+    NewArg->setName(Arg.getName());
+    VMap[&Arg] = &*NewArg++;
+  }
+  for (Instruction &I : instructions(F))
+    for (Value *Op : I.operands())
+      declareGlobals(M, Op, VMap);
+  SmallVector<ReturnInst *, 4> Returns;
+  CloneFunctionInto(NewF, &F, VMap, CloneFunctionChangeType::DifferentModule, Returns);
+  // Senza informazioni di debug la copia lascia vuota la lista delle unità di
+  // compilazione, che alla lettura causerebbe un avviso
+  if (NamedMDNode *CUs = M.getNamedMetadata("llvm.dbg.cu"))
+    if (!CUs->getNumOperands())
+      M.eraseNamedMetadata(CUs);
+
+  int FD;
+  SmallString<128> Tmp;
+  if (sys::fs::createUniqueFile(Path + ".%%%%%%%%.tmp", FD, Tmp))
+    return;
+  raw_fd_ostream OS(FD, true);
+  WriteBitcodeToFile(M, OS);
+  OS.close();
+  if (OS.has_error())
+  {
+    OS.clear_error();
+    sys::fs::remove(Tmp);
+  }
+  else if (sys::fs::rename(Tmp, Path))
+    sys::fs::remove(Tmp);
+}
+
+/************************* Root tree *************************/
+// Con -g le informazioni di debug dipendono dalle posizioni dei nodi, che
+// devono dunque far parte della chiave della cache
+void RootAST::hashLoc(driver &drv, MD5 &H)
+{
+  if (drv.opts.debug_info)
+  {
+    hashValue(H, Loc.Line);
+    hashValue(H, Loc.Col);
+  }
+}
+
+// Tutti i nodi sono allocati nell'arena del driver, in modo contiguo
+void *RootAST::operator new(size_t size, driver &drv)
+{
+  drv.Stats.Nodes++;
+  void *P = drv.arena.Allocate(size, alignof(std::max_align_t));
+  if (drv.Stats.Enabled)
+    drv.NewNodes.push_back(static_cast<RootAST *>(P));
+  return P;
+};
+
+// In generale il valore intero di un'espressione si ottiene convertendo il
+// suo valore double (una sola conversione, senza passare per float e i32)
+Value *ExprAST::codegenInt(driver &drv)
+{
+  TimeRegion Region(drv, "ExprAST::codegenInt");
+  Value *V = codegen(drv);
+  if (!V)
+    return nullptr;
+  if (V->getType()->isVectorTy())
+    return LogErrorV("Un vettore non può essere usato come indice o dimensione");
+  return drv.builder->CreateFPToSI(V, Type::getInt64Ty(*drv.context), "idx");
+};
+
+Value *ExprAST::codegenArray(driver &drv, bool &Local)
+{
+  return LogErrorV("Un parametro array richiede il nome di un array");
+}
+
+// Tipo dei valori con Width elementi: double se Width è 0, altrimenti il
+// vettore <Width x double> (vec2, vec4, vec8)
+static Type *valueType(driver &drv, unsigned Width)
+{
+  Type *DoubleTy = Type::getDoubleTy(*drv.context);
+  return Width ? FixedVectorType::get(DoubleTy, Width) : DoubleTy;
+}
 
-// Implementazione del metodo parse
-int driver::parse(const std::string &f)
+static unsigned widthOf(Type *T)
 {
-  file = f;                              // File con il programma
-  location.initialize(&file);            // Inizializzazione dell'oggetto location
-  scan_begin();                          // Inizio scanning (ovvero apertura del file programma)
-  yy::parser parser(*this);              // Istanziazione del parser
-  parser.set_debug_level(trace_parsing); // Livello di debug del parsed
-  int res = parser.parse();              // Chiamata dell'entry point del parser
-  scan_end();                            // Fine scanning (ovvero chiusura del file programma)
-  return res;
+  auto *VT = dyn_cast<FixedVectorType>(T);
+  return VT ? VT->getNumElements() : 0;
 }
 
-// Implementazione del metodo codegen, che è una "semplice" chiamata del
-// metodo omonimo presente nel nodo root (il puntatore root è stato scritto dal parser)
-void driver::codegen()
+static std::string typeName(Type *T)
 {
-  root->codegen(*this);
-};
+  if (!T->isVectorTy())
+    return T->isIntegerTy(1) ? "condizione" : "double";
+  return (T->getScalarType()->isIntegerTy(1) ? "maschera" : "vec") + std::to_string(widthOf(T));
+}
 
-/************************* Sequence tree **************************/
-SeqAST::SeqAST(RootAST *first, RootAST *continuation) : first(first), continuation(continuation){};
+// Converte V nel tipo T. Uno scalare diventa un vettore replicandolo in tutti
+// gli elementi (v * 2 raddoppia ogni elemento di v, una condizione combinata
+// con una maschera vale per tutti gli elementi); ogni altra conversione, ad
+// esempio fra vettori di larghezza diversa, è un errore
+static Value *convertTo(driver &drv, Value *V, Type *T)
+{
+  if (!V || V->getType() == T)
+    return V;
+  if (T->isVectorTy() && V->getType() == T->getScalarType())
+    return drv.builder->CreateVectorSplat(widthOf(T), V, "splat");
+  return LogErrorV("Tipi incompatibili: " + typeName(V->getType()) + " usato come " + typeName(T));
+}
 
-// La generazione del codice per una sequenza è banale:
-// mediante chiamate ricorsive viene generato il codice di first e
-// poi quello di continuation (con gli opportuni controlli di "esistenza")
-Value *SeqAST::codegen(driver &drv)
+// Come convertTo, ma per un valore che proviene dal blocco BB (argomento
+// di un PHI): la conversione va inserita prima del salto che chiude BB
+static Value *convertIn(driver &drv, BasicBlock *BB, Value *V, Type *T)
 {
-  if (first != nullptr)
-  {
-    Value *f = first->codegen(drv);
-  }
-  else
+  if (!V || V->getType() == T)
+    return V;
+  IRBuilderBase::InsertPointGuard Guard(*drv.builder);
+  drv.builder->SetInsertPoint(BB->getTerminator());
+  return convertTo(drv, V, T);
+}
+
+// Pesi dei rami per likely/unlikely (gli stessi usati da clang per __builtin_expect)
+static const uint32_t LikelyWeight = 2000, UnlikelyWeight = 1;
+
+// Una condizione semplice viene valutata e seguita da un salto condizionato,
+// annotato con i pesi dei rami se è stato indicato un suggerimento
+bool ExprAST::codegenBranch(driver &drv, BasicBlock *TrueBB, BasicBlock *FalseBB, int Hint)
+{
+  TimeRegion Region(drv, "ExprAST::codegenBranch");
+  Value *CondV = codegen(drv);
+  if (!CondV)
+    return false;
+  if (CondV->getType()->isVectorTy())
   {
-    if (continuation == nullptr)
-      return nullptr;
+    LogErrorV("Una maschera non può decidere un salto: si usi any(...) o all(...)");
+    return false;
   }
-  Value *c = continuation->codegen(drv);
-  return nullptr;
+  MDNode *Weights = nullptr;
+  if (Hint > 0)
+    Weights = MDBuilder(*drv.context).createBranchWeights(LikelyWeight, UnlikelyWeight);
+  else if (Hint < 0)
+    Weights = MDBuilder(*drv.context).createBranchWeights(UnlikelyWeight, LikelyWeight);
+  drv.builder->CreateCondBr(CondV, TrueBB, FalseBB, Weights);
+  return true;
 };
 
 /********************* Number Expression Tree *********************/
@@ -80,7 +1431,7 @@ NumberExprAST::NumberExprAST(double Val) : Val(Val){};
 
 lexval NumberExprAST::getLexVal() const
 {
-  // Non utilizzata, Inserita per continuità con versione precedente
+  // Usata dalla semplificazione per leggere il valore della costante
   lexval lval = Val;
   return lval;
 };
@@ -91,51 +1442,333 @@ lexval NumberExprAST::getLexVal() const
 // Si noti che l'uso del contesto garantisce l'unicità della costanti
 Value *NumberExprAST::codegen(driver &drv)
 {
-  return ConstantFP::get(*context, APFloat(Val));
+  TimeRegion Region(drv, "NumberExprAST::codegen");
+  return ConstantFP::get(*drv.context, APFloat(Val));
+};
+
+// Sono interi i valori senza parte frazionaria rappresentabili esattamente
+// in double (|Val| < 2^53)
+bool NumberExprAST::isInteger(driver &drv)
+{
+  return Val == std::trunc(Val) && std::fabs(Val) < 0x1p53;
+};
+
+Value *NumberExprAST::codegenInt(driver &drv)
+{
+  TimeRegion Region(drv, "NumberExprAST::codegenInt");
+  if (!isInteger(drv))
+    return ExprAST::codegenInt(drv);
+  return ConstantInt::get(Type::getInt64Ty(*drv.context), (int64_t)Val, true);
+};
+
+void NumberExprAST::hash(driver &drv, MD5 &H)
+{
+  hashLoc(drv, H);
+  hashValue(H, 'N');
+  hashValue(H, bit_cast<uint64_t>(Val));
+};
+
+/********************** Bool Expression Tree **********************/
+BoolExprAST::BoolExprAST(bool Val) : Val(Val){};
+
+lexval BoolExprAST::getLexVal() const
+{
+  lexval lval = Val ? 1.0 : 0.0;
+  return lval;
+};
+
+Value *BoolExprAST::codegen(driver &drv)
+{
+  TimeRegion Region(drv, "BoolExprAST::codegen");
+  return ConstantInt::getBool(*drv.context, Val);
+};
+
+void BoolExprAST::hash(driver &drv, MD5 &H)
+{
+  hashLoc(drv, H);
+  hashValue(H, 'B');
+  hashValue(H, Val);
 };
 
+// Valore di una costante numerica o di una condizione costante, se E lo è
+static bool getConstant(ExprAST *E, double &V)
+{
+  if (!dynamic_cast<NumberExprAST *>(E))
+    return false;
+  V = std::get<double>(E->getLexVal());
+  return true;
+}
+
+static bool getCondition(ExprAST *E, bool &C)
+{
+  if (!dynamic_cast<BoolExprAST *>(E))
+    return false;
+  C = std::get<double>(E->getLexVal()) != 0.0;
+  return true;
+}
+
 /******************** Variable Expression Tree ********************/
-VariableExprAST::VariableExprAST(const std::string &Name) : Name(Name){};
+VariableExprAST::VariableExprAST(StringRef Name) : Name(Name){};
 
 lexval VariableExprAST::getLexVal() const
 {
-  lexval lval = Name;
+  lexval lval = Name.str();
   return lval;
 };
 
-// NamedValues è una tabella che ad ogni variabile (che, in Kaleidoscope1.0,
-// può essere solo un parametro di funzione) associa non un valore bensì
-// la rappresentazione di una funzione che alloca memoria e restituisce in un
-// registro SSA il puntatore alla memoria allocata. Generare il codice corrispondente
-// ad una varibile equivale dunque a recuperare il tipo della variabile
-// allocata e il nome del registro e generare una corrispondente istruzione di load
-// Negli argomenti della CreateLoad ritroviamo quindi: (1) il tipo allocato, (2) il registro
-// SSA in cui è stato messo il puntatore alla memoria allocata (si ricordi che A è
-// l'istruzione ma è anche il registro, vista la corrispodenza 1-1 fra le due nozioni), (3)
-// il nome del registro in cui verrà trasferito il valore dalla memoria
+// La risoluzione dei nomi lega il riferimento allo slot della variabile
+// locale visibile in quel punto (o alla globale omonima), senza generare codice
+bool VariableExprAST::resolve(driver &drv)
+{
+  return drv.resolve(Name, Ref);
+}
+
+void VariableExprAST::hash(driver &drv, MD5 &H)
+{
+  hashLoc(drv, H);
+  hashValue(H, 'V');
+  hashValue(H, Name);
+  hashValue(H, Ref);
+}
+
+// Lo slot contiene l'istruzione alloca che riserva la memoria della variabile
+// e restituisce in un registro SSA il puntatore alla memoria allocata (lo slot
+// è riempito dalla codegen del parametro o del binding corrispondente). Generare
+// il codice corrispondente ad una varibile equivale dunque a recuperare il tipo
+// della variabile allocata e il nome del registro e generare una corrispondente
+// istruzione di load. Negli argomenti della CreateLoad ritroviamo quindi: (1) il
+// tipo allocato, (2) il registro SSA in cui è stato messo il puntatore alla
+// memoria allocata, (3) il nome del registro in cui verrà trasferito il valore
+// dalla memoria
+// Le variabili intere sono convertite in double quando il loro valore è usato
+// come tale
 Value *VariableExprAST::codegen(driver &drv)
 {
-  AllocaInst *A = drv.NamedValues[Name];
-  if (!A)
-  {
-    GlobalVariable *gVar = module->getNamedGlobal(Name);
-    if (gVar != nullptr)
-      return builder->CreateLoad(gVar->getValueType(), gVar, Name);
-    else
-      return LogErrorV("Variabile " + Name + " non definita");
-  }
-  return builder->CreateLoad(A->getAllocatedType(), A, Name.c_str());
+  TimeRegion Region(drv, "VariableExprAST::codegen");
+  DebugLocation DL(drv, this);
+  if (drv.isArray(Ref))
+    return LogErrorV("L'array " + Name + " non può essere usato come valore");
+  if (Ref.Global)
+    return drv.builder->CreateLoad(Ref.Global->getValueType(), Ref.Global, Name);
+  AllocaInst *A = drv.Slots[Ref.Slot];
+  Value *V = drv.builder->CreateLoad(A->getAllocatedType(), A, Name);
+  if (isInteger(drv))
+    return drv.builder->CreateSIToFP(V, Type::getDoubleTy(*drv.context), "conv");
+  return V;
+}
+
+unsigned VariableExprAST::vectorWidth(driver &drv)
+{
+  return Ref.Global ? 0 : widthOf(drv.SlotTypes[Ref.Slot]);
+}
+
+bool VariableExprAST::isInteger(driver &drv)
+{
+  return !Ref.Global && drv.SlotTypes[Ref.Slot]->isIntegerTy();
+}
+
+Value *VariableExprAST::codegenInt(driver &drv)
+{
+  TimeRegion Region(drv, "VariableExprAST::codegenInt");
+  DebugLocation DL(drv, this);
+  if (!isInteger(drv))
+    return ExprAST::codegenInt(drv);
+  AllocaInst *A = drv.Slots[Ref.Slot];
+  return drv.builder->CreateLoad(A->getAllocatedType(), A, Name);
+}
+
+// Un parametro array è memoria del chiamante, come una variabile globale
+Value *VariableExprAST::codegenArray(driver &drv, bool &Local)
+{
+  TimeRegion Region(drv, "VariableExprAST::codegenArray");
+  DebugLocation DL(drv, this);
+  if (!drv.isArray(Ref))
+    return LogErrorV("Variabile " + Name + " non è un array");
+  Local = !Ref.Global && Ref.Slot >= drv.builder->GetInsertBlock()->getParent()->arg_size();
+  return drv.address(Ref);
 }
 
 /******************** Binary Expression Tree **********************/
 BinaryExprAST::BinaryExprAST(char Op, ExprAST *LHS, ExprAST *RHS) : Op(Op), LHS(LHS), RHS(RHS){};
 
+bool BinaryExprAST::resolve(driver &drv)
+{
+  return LHS->resolve(drv) && (!RHS || RHS->resolve(drv));
+}
+
+// Somme e differenze di interi sono intere. Il prodotto non è considerato
+// intero: calcolato in i64 potrebbe traboccare dove il double non trabocca
+bool BinaryExprAST::isInteger(driver &drv)
+{
+  return (Op == '+' || Op == '-') && LHS->isInteger(drv) && RHS->isInteger(drv);
+}
+
+// Il passo è limitato a 2^32: anche così una variabile di induzione
+// richiede miliardi di iterazioni prima di uscire dall'intervallo di i64
+bool BinaryExprAST::isStep(unsigned Slot)
+{
+  auto isVar = [Slot](ExprAST *E) {
+    auto *V = dynamic_cast<VariableExprAST *>(E);
+    return V && !V->getRef().Global && V->getRef().Slot == (int)Slot;
+  };
+  auto isConst = [](ExprAST *E) {
+    double C;
+    return getConstant(E, C) && C == std::trunc(C) && std::fabs(C) <= 0x1p32;
+  };
+  return (Op == '+' && ((isVar(LHS) && isConst(RHS)) || (isConst(LHS) && isVar(RHS)))) ||
+         (Op == '-' && isVar(LHS) && isConst(RHS));
+}
+
+// Un'operazione con un operando vettoriale è un vettore della stessa
+// larghezza (lo scalare viene replicato), un confronto fra vettori una
+// maschera; any e all riducono una maschera a una condizione
+unsigned BinaryExprAST::vectorWidth(driver &drv)
+{
+  if (Op == 'E' || Op == 'F')
+    return 0;
+  return std::max(LHS->vectorWidth(drv), RHS ? RHS->vectorWidth(drv) : 0);
+}
+
+// In un contesto intero (indici) anche il prodotto di interi è calcolato in
+// i64: l'indice risultante deve comunque essere rappresentabile
+Value *BinaryExprAST::codegenInt(driver &drv)
+{
+  TimeRegion Region(drv, "BinaryExprAST::codegenInt");
+  DebugLocation DL(drv, this);
+  if (Op == 'm' && LHS->isInteger(drv))
+  {
+    Value *L = LHS->codegenInt(drv);
+    return L ? drv.builder->CreateNSWNeg(L, "negres") : nullptr;
+  }
+  if ((Op != '+' && Op != '-' && Op != '*') || !LHS->isInteger(drv) || !RHS->isInteger(drv))
+    return ExprAST::codegenInt(drv);
+  Value *L = LHS->codegenInt(drv);
+  Value *R = RHS->codegenInt(drv);
+  if (!L || !R)
+    return nullptr;
+  switch (Op)
+  {
+  case '+':
+    return drv.builder->CreateAdd(L, R, "addres");
+  case '-':
+    return drv.builder->CreateSub(L, R, "subres");
+  default:
+    return drv.builder->CreateNSWMul(L, R, "mulres");
+  }
+}
+
+// Arrotonda un double all'intero superiore (Up) o inferiore, convertendolo in
+// i64 con saturazione (NaN vale 0). Non si usano gli intrinsic ceil/floor: senza
+// SSE4.1 diventano chiamate alle funzioni di libreria omonime, che un programma
+// Kaleidoscope può ridefinire (si veda floor.k)
+static Value *CreateRoundToInt(driver &drv, Value *V, bool Up)
+{
+  Type *I64 = Type::getInt64Ty(*drv.context);
+  Value *T = drv.builder->CreateIntrinsic(Intrinsic::fptosi_sat, {I64, V->getType()}, {V});
+  Value *TF = drv.builder->CreateSIToFP(T, V->getType());
+  Value *Adj = drv.builder->CreateZExt(Up ? drv.builder->CreateFCmpOLT(TF, V)
+                                          : drv.builder->CreateFCmpOGT(TF, V), I64);
+  return drv.builder->CreateBinaryIntrinsic(Up ? Intrinsic::sadd_sat : Intrinsic::ssub_sat, T, Adj);
+}
+
+// Confronto in cui compare un intero. Fra due interi si usa icmp; fra un
+// intero i e un double x, i < x equivale a i < ceil(x) e i > x a i > floor(x)
+// (simmetricamente quando l'intero è a destra). La condizione di uscita dei
+// cicli con contatore intero resta così un confronto fra interi, da cui SCEV
+// ricava il numero di iterazioni. Il confronto fra double è però non ordinato
+// (ult/ugt) e vale vero se x è NaN: x NaN è allora arrotondato all'estremo
+// che rende vero il confronto (INT64_MAX per ceil, INT64_MIN per floor), così
+// che la condizione resti un solo icmp. Fa eccezione solo un contatore pari a
+// quell'estremo, che non si raggiunge. Nelle funzioni fast (nnan) la select
+// si omette
+static Value *CreateIntCompare(driver &drv, char Op, ExprAST *LHS, ExprAST *RHS)
+{
+  auto operand = [&](ExprAST *E, bool Up) -> Value * {
+    if (E->isInteger(drv))
+      return E->codegenInt(drv);
+    Value *V = E->codegen(drv);
+    if (!V)
+      return nullptr;
+    Value *I = CreateRoundToInt(drv, V, Up);
+    if (drv.builder->getFastMathFlags().noNaNs())
+      return I;
+    int64_t Bound = Up ? INT64_MAX : INT64_MIN;
+    return drv.builder->CreateSelect(drv.builder->CreateFCmpUNO(V, V, "nantest"),
+                                     drv.builder->getInt64(Bound), I);
+  };
+  Value *L = operand(LHS, Op != '<');
+  Value *R = operand(RHS, Op == '<');
+  if (!L || !R)
+    return nullptr;
+  switch (Op)
+  {
+  case '<':
+    return drv.builder->CreateICmpSLT(L, R, "lttest");
+  case '>':
+    return drv.builder->CreateICmpSGT(L, R, "gttest");
+  default:
+    return drv.builder->CreateICmpEQ(L, R, "eqtest");
+  }
+}
+
 // La generazione del codice in questo caso è di facile comprensione.
 // Vengono ricorsivamente generati il codice per il primo e quello per il secondo
 // operando. Con i valori memorizzati in altrettanti registri SSA si
 // costruisce l'istruzione utilizzando l'opportuno operatore
 Value *BinaryExprAST::codegen(driver &drv)
 {
+  TimeRegion Region(drv, "BinaryExprAST::codegen");
+  DebugLocation DL(drv, this);
+  // any(m) e all(m): la maschera è ridotta con un or (and) dei suoi elementi;
+  // una condizione scalare resta invariata
+  if (Op == 'E' || Op == 'F')
+  {
+    Value *M = LHS->codegen(drv);
+    if (!M || !M->getType()->isVectorTy())
+      return M;
+    return Op == 'E' ? drv.builder->CreateOrReduce(M) : drv.builder->CreateAndReduce(M);
+  }
+  if (unsigned Width = vectorWidth(drv))
+    return codegenVector(drv, Width);
+  // Il valore di una condizione composta si ottiene dal codice a salti:
+  // i due esiti si riuniscono in una PHI
+  if (Op == 'a' || Op == 'o' || Op == 'n' || Op == 'l' || Op == 'u')
+  {
+    Function *function = drv.builder->GetInsertBlock()->getParent();
+    BasicBlock *TrueBB = BasicBlock::Create(*drv.context, "condtrue");
+    BasicBlock *FalseBB = BasicBlock::Create(*drv.context, "condfalse");
+    BasicBlock *MergeBB = BasicBlock::Create(*drv.context, "condend");
+    if (!codegenBranch(drv, TrueBB, FalseBB, 0))
+      return nullptr;
+    function->insert(function->end(), TrueBB);
+    drv.builder->SetInsertPoint(TrueBB);
+    drv.builder->CreateBr(MergeBB);
+    function->insert(function->end(), FalseBB);
+    drv.builder->SetInsertPoint(FalseBB);
+    drv.builder->CreateBr(MergeBB);
+    function->insert(function->end(), MergeBB);
+    drv.builder->SetInsertPoint(MergeBB);
+    PHINode *PN = drv.builder->CreatePHI(Type::getInt1Ty(*drv.context), 2, "condval");
+    PN->addIncoming(drv.builder->getTrue(), TrueBB);
+    PN->addIncoming(drv.builder->getFalse(), FalseBB);
+    return PN;
+  }
+  // Le espressioni intere sono calcolate in i64 e convertite una volta sola
+  if (isInteger(drv))
+  {
+    Value *V = codegenInt(drv);
+    return V ? drv.builder->CreateSIToFP(V, Type::getDoubleTy(*drv.context), "conv") : nullptr;
+  }
+  // Confronti fra interi, o fra una variabile intera e un double (ma non fra
+  // un double e una costante intera, che resta un confronto fra double)
+  if (Op == '<' || Op == '>' || Op == '=')
+  {
+    bool LInt = LHS->isInteger(drv), RInt = RHS->isInteger(drv);
+    bool LVar = LInt && !dynamic_cast<NumberExprAST *>(LHS);
+    bool RVar = RInt && !dynamic_cast<NumberExprAST *>(RHS);
+    if ((LInt && RInt) || (Op != '=' && (LVar || RVar)))
+      return CreateIntCompare(drv, Op, LHS, RHS);
+  }
   Value *L = LHS->codegen(drv);
   Value *R;
   if (RHS)
@@ -145,55 +1778,366 @@ Value *BinaryExprAST::codegen(driver &drv)
   switch (Op)
   {
   case '+':
-    return builder->CreateFAdd(L, R, "addres");
+    return drv.builder->CreateFAdd(L, R, "addres");
+  case '-':
+    return drv.builder->CreateFSub(L, R, "subres");
+  case '*':
+    return drv.builder->CreateFMul(L, R, "mulres");
+  case '/':
+    return drv.builder->CreateFDiv(L, R, "addres");
+  case 'm':
+    return drv.builder->CreateFNeg(L, "negres");
+  case '<':
+    return drv.builder->CreateFCmpULT(L, R, "lttest");
+  case '>':
+    return drv.builder->CreateFCmpUGT(L, R, "gttest");
+  case '=':
+    return drv.builder->CreateFCmpUEQ(L, R, "eqtest");
+  default:
+    std::cout << Op << std::endl;
+    return LogErrorV("Operatore binario non supportato");
+  }
+};
+
+// Operazioni elemento per elemento fra vettori, o fra un vettore e uno
+// scalare replicato. I confronti producono maschere <Width x i1>, combinate da
+// and, or e not senza short-circuit (entrambi gli operandi sono sempre
+// valutati: non c'è un salto per elemento)
+Value *BinaryExprAST::codegenVector(driver &drv, unsigned Width)
+{
+  bool Mask = Op == 'a' || Op == 'o' || Op == 'n' || Op == 'l' || Op == 'u';
+  Type *T = Mask ? FixedVectorType::get(Type::getInt1Ty(*drv.context), Width) : valueType(drv, Width);
+  Value *L = convertTo(drv, LHS->codegen(drv), T);
+  if (!L)
+    return nullptr;
+  Value *R = nullptr;
+  if (RHS && !(R = convertTo(drv, RHS->codegen(drv), T)))
+    return nullptr;
+  switch (Op)
+  {
+  case '+':
+    return drv.builder->CreateFAdd(L, R, "addres");
   case '-':
-    return builder->CreateFSub(L, R, "subres");
+    return drv.builder->CreateFSub(L, R, "subres");
   case '*':
-    return builder->CreateFMul(L, R, "mulres");
+    return drv.builder->CreateFMul(L, R, "mulres");
   case '/':
-    return builder->CreateFDiv(L, R, "addres");
+    return drv.builder->CreateFDiv(L, R, "divres");
+  case 'm':
+    return drv.builder->CreateFNeg(L, "negres");
   case '<':
-    return builder->CreateFCmpULT(L, R, "lttest");
+    return drv.builder->CreateFCmpULT(L, R, "lttest");
   case '>':
-    return builder->CreateFCmpUGT(L, R, "gttest");
+    return drv.builder->CreateFCmpUGT(L, R, "gttest");
   case '=':
-    return builder->CreateFCmpUEQ(L, R, "eqtest");
+    return drv.builder->CreateFCmpUEQ(L, R, "eqtest");
   case 'a':
-    return builder->CreateAnd(L, R, "andtest");
+    return drv.builder->CreateAnd(L, R, "andmask");
   case 'o':
-    return builder->CreateOr(L, R, "ortest");
+    return drv.builder->CreateOr(L, R, "ormask");
   case 'n':
-    return builder->CreateNot(L, "nottest");
+    return drv.builder->CreateNot(L, "notmask");
   default:
-    std::cout << Op << std::endl;
-    return LogErrorV("Operatore binario non supportato");
+    // likely/unlikely non hanno effetto su una maschera
+    return L;
+  }
+}
+
+// Codice a salti per le condizioni composte (valutazione short-circuit):
+// il secondo operando di and/or viene valutato solo se il primo non basta
+// a determinare l'esito. I suggerimenti likely/unlikely si propagano alle
+// condizioni semplici, mentre not scambia le destinazioni e il suggerimento
+bool BinaryExprAST::codegenBranch(driver &drv, BasicBlock *TrueBB, BasicBlock *FalseBB, int Hint)
+{
+  TimeRegion Region(drv, "BinaryExprAST::codegenBranch");
+  DebugLocation DL(drv, this);
+  Function *function = drv.builder->GetInsertBlock()->getParent();
+  BasicBlock *RhsBB;
+  switch (Op)
+  {
+  case 'n':
+    return LHS->codegenBranch(drv, FalseBB, TrueBB, -Hint);
+  case 'l':
+    return LHS->codegenBranch(drv, TrueBB, FalseBB, 1);
+  case 'u':
+    return LHS->codegenBranch(drv, TrueBB, FalseBB, -1);
+  case 'a':
+    // Se il primo operando è falso, l'and è falso
+    RhsBB = BasicBlock::Create(*drv.context, "andrhs");
+    if (!LHS->codegenBranch(drv, RhsBB, FalseBB, Hint))
+      return false;
+    break;
+  case 'o':
+    // Se il primo operando è vero, l'or è vero
+    RhsBB = BasicBlock::Create(*drv.context, "orrhs");
+    if (!LHS->codegenBranch(drv, TrueBB, RhsBB, Hint))
+      return false;
+    break;
+  default:
+    return ExprAST::codegenBranch(drv, TrueBB, FalseBB, Hint);
+  }
+  // Il blocco del secondo operando segue quelli generati per il primo
+  function->insert(function->end(), RhsBB);
+  drv.builder->SetInsertPoint(RhsBB);
+  return RHS->codegenBranch(drv, TrueBB, FalseBB, Hint);
+};
+
+// Semplificazione: le operazioni fra costanti sono calcolate in double, come
+// le calcolerebbe il codice generato, e i confronti fra costanti diventano
+// condizioni costanti (con la semantica "unordered" usata per i NaN).
+// x*1, 1*x e x/1 valgono x, il prodotto per -1 (il meno unario) e la divisione
+// per -1 diventano una negazione (fneg); x+0 vale x solo se il segno dello
+// zero può essere ignorato (-0+0 è +0), x-0 e x+(-0) valgono sempre x.
+// Nelle condizioni composte, un operando costante decide l'esito o sparisce
+ExprAST *BinaryExprAST::fold(driver &drv)
+{
+  LHS = LHS->fold(drv);
+  if (RHS)
+    RHS = RHS->fold(drv);
+  double L, R;
+  bool LConst = getConstant(LHS, L), RConst = RHS && getConstant(RHS, R);
+  bool LCond, RCond;
+  bool LBool = getCondition(LHS, LCond), RBool = RHS && getCondition(RHS, RCond);
+  bool NSZ = drv.builder->getFastMathFlags().noSignedZeros();
+  switch (Op)
+  {
+  case '+':
+    if (LConst && RConst)
+      return new (drv) NumberExprAST(L + R);
+    if (RConst && R == 0 && (std::signbit(R) || NSZ))
+      return LHS;
+    if (LConst && L == 0 && (std::signbit(L) || NSZ))
+      return RHS;
+    break;
+  case '-':
+    if (LConst && RConst)
+      return new (drv) NumberExprAST(L - R);
+    if (RConst && R == 0 && (!std::signbit(R) || NSZ))
+      return LHS;
+    break;
+  case '*':
+    if (LConst && RConst)
+      return new (drv) NumberExprAST(L * R);
+    if (RConst && (R == 1 || R == -1))
+      return R == 1 ? LHS : new (drv) BinaryExprAST('m', LHS);
+    if (LConst && (L == 1 || L == -1))
+      return L == 1 ? RHS : new (drv) BinaryExprAST('m', RHS);
+    break;
+  case '/':
+    if (LConst && RConst)
+      return new (drv) NumberExprAST(L / R);
+    if (RConst && (R == 1 || R == -1))
+      return R == 1 ? LHS : new (drv) BinaryExprAST('m', LHS);
+    break;
+  case 'm':
+    if (LConst)
+      return new (drv) NumberExprAST(-L);
+    break;
+  case '<':
+    if (LConst && RConst)
+      return new (drv) BoolExprAST(!(L >= R));
+    break;
+  case '>':
+    if (LConst && RConst)
+      return new (drv) BoolExprAST(!(L <= R));
+    break;
+  case '=':
+    if (LConst && RConst)
+      return new (drv) BoolExprAST(!(L < R || L > R));
+    break;
+  case 'a':
+    // Il secondo operando non può essere eliminato se il primo non è
+    // costante: la sua valutazione potrebbe avere effetti (chiamate)
+    if (LBool)
+      return LCond ? RHS : LHS;
+    if (RBool && RCond)
+      return LHS;
+    break;
+  case 'o':
+    if (LBool)
+      return LCond ? LHS : RHS;
+    if (RBool && !RCond)
+      return LHS;
+    break;
+  case 'n':
+    if (LBool)
+      return new (drv) BoolExprAST(!LCond);
+    break;
+  case 'l':
+  case 'u':
+  case 'E':
+  case 'F':
+    if (LBool)
+      return LHS;
+    break;
   }
+  return this;
+};
+
+void BinaryExprAST::hash(driver &drv, MD5 &H)
+{
+  hashLoc(drv, H);
+  hashValue(H, Op);
+  LHS->hash(drv, H);
+  if (RHS)
+    RHS->hash(drv, H);
+};
+
+/*************************** Builtins *****************************/
+// Funzioni della libreria matematica del C che il compilatore conosce. Se un
+// programma le dichiara extern con il numero di argomenti previsto, le
+// chiamate sono tradotte nell'intrinsic LLVM indicato oppure, se non esiste
+// un intrinsic, in chiamate a una funzione che non accede alla memoria.
+// Un programma Kaleidoscope non può leggere errno, dunque ignorare gli effetti
+// di queste funzioni su errno non ne cambia il comportamento osservabile
+struct builtin
+{
+  const char *Name;
+  unsigned Arity;
+  Intrinsic::ID ID;
+};
+
+static const builtin Builtins[] = {
+    {"floor", 1, Intrinsic::floor},     {"ceil", 1, Intrinsic::ceil},
+    {"trunc", 1, Intrinsic::trunc},     {"round", 1, Intrinsic::round},
+    {"rint", 1, Intrinsic::rint},       {"nearbyint", 1, Intrinsic::nearbyint},
+    {"sqrt", 1, Intrinsic::sqrt},       {"fabs", 1, Intrinsic::fabs},
+    {"exp", 1, Intrinsic::exp},         {"exp2", 1, Intrinsic::exp2},
+    {"log", 1, Intrinsic::log},         {"log2", 1, Intrinsic::log2},
+    {"log10", 1, Intrinsic::log10},     {"sin", 1, Intrinsic::sin},
+    {"cos", 1, Intrinsic::cos},         {"pow", 2, Intrinsic::pow},
+    {"fma", 3, Intrinsic::fma},         {"copysign", 2, Intrinsic::copysign},
+    {"fmin", 2, Intrinsic::minnum},     {"fmax", 2, Intrinsic::maxnum},
+    {"tan", 1, Intrinsic::not_intrinsic},   {"asin", 1, Intrinsic::not_intrinsic},
+    {"acos", 1, Intrinsic::not_intrinsic},  {"atan", 1, Intrinsic::not_intrinsic},
+    {"atan2", 2, Intrinsic::not_intrinsic}, {"sinh", 1, Intrinsic::not_intrinsic},
+    {"cosh", 1, Intrinsic::not_intrinsic},  {"tanh", 1, Intrinsic::not_intrinsic},
+    {"cbrt", 1, Intrinsic::not_intrinsic},  {"hypot", 2, Intrinsic::not_intrinsic},
+    {"fmod", 2, Intrinsic::not_intrinsic},  {"expm1", 1, Intrinsic::not_intrinsic},
+    {"log1p", 1, Intrinsic::not_intrinsic},
 };
 
+// Restituisce la voce della tabella per una funzione dichiarata extern (una
+// funzione definita nel programma non è mai un builtin), nullptr se la
+// funzione non è nota o se i builtin sono disabilitati (-fno-builtin[-nome]).
+// Un builtin chiamato con argomenti vettoriali opera elemento per elemento
+// (l'intrinsic è sovraccaricato sul tipo del vettore)
+static const builtin *getBuiltin(driver &drv, Function *F)
+{
+  if (!F->isDeclaration() || F->isIntrinsic() || !drv.opts.builtins || !F->getReturnType()->isDoubleTy() ||
+      any_of(F->args(), [](Argument &A) { return !A.getType()->isDoubleTy(); }))
+    return nullptr;
+  StringRef Name = F->getName();
+  for (const std::string &N : drv.opts.no_builtins)
+    if (Name == N)
+      return nullptr;
+  for (const builtin &B : Builtins)
+    if (Name == B.Name && F->arg_size() == B.Arity)
+      return &B;
+  return nullptr;
+}
+
+// Operazioni predefinite sui vettori, disponibili se il programma non
+// definisce né dichiara una funzione con lo stesso nome:
+//   vecN(x), vecN(x1, ..., xN)    vettore di N elementi (N = 2, 4, 8)
+//   loadN(A, i)                   gli N elementi di A a partire da A[i]
+//   extract(v, i), insert(v, i, x)  lettura e sostituzione di un elemento
+//   shuffle(v, i1, ..., iK)       elementi di v (o di v seguito da w, con
+//   shuffle(v, w, i1, ..., iK)    shuffle(v, w, ...)) di indici costanti; K = 2, 4, 8
+//   hsum, hprod, hmin, hmax       riduzioni orizzontali di un vettore
+// La scrittura di un vettore in un array è un assegnamento: A[i] = v
+static unsigned vectorSuffix(StringRef Name, StringRef Prefix)
+{
+  if (!Name.consume_front(Prefix) || Name.size() != 1)
+    return 0;
+  return Name == "2" || Name == "4" || Name == "8" ? Name[0] - '0' : 0;
+}
+
+static bool isVectorBuiltin(StringRef Name)
+{
+  static const char *const Ops[] = {"extract", "insert", "shuffle", "hsum", "hprod", "hmin", "hmax"};
+  return vectorSuffix(Name, "vec") || vectorSuffix(Name, "load") ||
+         any_of(Ops, [&](const char *Op) { return Name == Op; });
+}
+
 /********************* Call Expression Tree ***********************/
 /* Call Expression Tree */
-CallExprAST::CallExprAST(std::string Callee, std::vector<ExprAST *> Args) : Callee(Callee), Args(std::move(Args)){};
+CallExprAST::CallExprAST(StringRef Callee, MutableArrayRef<ExprAST *> Args) : Callee(Callee), Args(Args){};
 
 lexval CallExprAST::getLexVal() const
 {
-  lexval lval = Callee;
+  lexval lval = Callee.str();
   return lval;
 };
 
+bool CallExprAST::resolve(driver &drv)
+{
+  for (auto arg : Args)
+    if (!arg->resolve(drv))
+      return false;
+  return true;
+}
+
+ExprAST *CallExprAST::fold(driver &drv)
+{
+  for (auto &arg : Args)
+    arg = arg->fold(drv);
+  return this;
+}
+
+bool CallExprAST::markTail(StringRef Caller)
+{
+  Tail = true;
+  return Callee == Caller;
+}
+
+// Il codice della chiamata dipende anche dal chiamato: dal numero e dal tipo
+// dei suoi parametri e dal fatto che sia definito nel programma o soltanto
+// dichiarato (una funzione extern può essere un builtin)
+void CallExprAST::hash(driver &drv, MD5 &H)
+{
+  hashLoc(drv, H);
+  hashValue(H, 'C');
+  hashValue(H, Callee);
+  Function *CalleeF = drv.module->getFunction(Callee);
+  hashValue(H, CalleeF ? CalleeF->arg_size() : -1);
+  hashValue(H, CalleeF && CalleeF->isDeclaration());
+  if (CalleeF)
+    for (Argument &A : CalleeF->args())
+    {
+      hashValue(H, A.getType()->isPointerTy());
+      hashValue(H, widthOf(A.getType()));
+      hashValue(H, CalleeF->getParamDereferenceableBytes(A.getArgNo()));
+      hashValue(H, CalleeF->getAttributes().getParamAttr(A.getArgNo(), "kcomp-length").getValueAsString());
+    }
+  hashValue(H, CalleeF ? widthOf(CalleeF->getReturnType()) : 0);
+  hashValue(H, Args.size());
+  for (auto arg : Args)
+    arg->hash(drv, H);
+}
+
 Value *CallExprAST::codegen(driver &drv)
 {
+  TimeRegion Region(drv, "CallExprAST::codegen");
+  DebugLocation DL(drv, this);
   // La generazione del codice corrispondente ad una chiamata di funzione
   // inizia cercando nel modulo corrente (l'unico, nel nostro caso) una funzione
   // il cui nome coincide con il nome memorizzato nel nodo dell'AST
   // Se la funzione non viene trovata (e dunque non è stata precedentemente definita)
   // viene generato un errore
-  Function *CalleeF = module->getFunction(Callee);
+  Function *CalleeF = drv.module->getFunction(Callee);
+  if (!CalleeF && isVectorBuiltin(Callee))
+    return codegenVector(drv);
   if (!CalleeF)
     return LogErrorV("Funzione non definita");
   // Il secondo controllo è che la funzione recuperata abbia tanti parametri
   // quanti sono gi argomenti previsti nel nodo AST
   if (CalleeF->arg_size() != Args.size())
     return LogErrorV("Numero di argomenti non corretto");
+  // Le versioni batch (con risultato void e un parametro long) sono
+  // destinate al codice C e non possono essere chiamate dal programma
+  if (CalleeF->getReturnType()->isVoidTy())
+    return LogErrorV("La funzione " + Callee + " non può essere chiamata dal programma");
   // Passato con successo anche il secondo controllo, viene predisposta
   // ricorsivamente la valutazione degli argomenti presenti nella chiamata
   // (si ricordi che gli argomenti possono essere espressioni arbitarie)
@@ -201,77 +2145,364 @@ Value *CallExprAST::codegen(driver &drv)
   // vengono inseriti in un vettore, dove "se li aspetta" il metodo CreateCall
   // del builder, che viene chiamato subito dopo per la generazione dell'istruzione
   // IR di chiamata
+  // A un parametro array si passa l'indirizzo di un array, che deve avere
+  // almeno gli elementi richiesti dal parametro quando entrambi sono noti.
+  // I parametri array sono noalias: lo stesso array non può essere passato a
+  // due di essi, né un array globale a una funzione del programma, che
+  // potrebbe accedervi anche direttamente. L'identità di un parametro array
+  // o di un array sul heap è il suo slot (da cui è letto l'indirizzo)
+  // A un parametro vettoriale si può passare anche un double, replicato
+  const builtin *B = getBuiltin(drv, CalleeF);
+  unsigned Width = B ? vectorWidth(drv) : 0;
+  if (Width && B->ID == Intrinsic::not_intrinsic)
+    return LogErrorV("La funzione " + Callee + " non può essere applicata a un vettore");
   std::vector<Value *> ArgsV;
+  SmallVector<Value *, 4> Arrays;
+  SmallVector<uint64_t, 8> Elements(Args.size()); // Elementi degli array passati, se noti
+  bool LocalArray = false;
   for (auto arg : Args)
   {
-    ArgsV.push_back(arg->codegen(drv));
+    unsigned i = ArgsV.size();
+    Type *T = Width ? valueType(drv, Width) : CalleeF->getArg(i)->getType();
+    if (!T->isPointerTy())
+      ArgsV.push_back(convertTo(drv, arg->codegen(drv), T));
+    else
+    {
+      bool Local = false;
+      ArgsV.push_back(arg->codegenArray(drv, Local));
+      LocalArray |= Local;
+      if (!ArgsV.back())
+        return nullptr;
+      uint64_t Required = CalleeF->getParamDereferenceableBytes(i);
+      Value *Base = getUnderlyingObject(ArgsV.back());
+      Type *T = isa<AllocaInst>(Base) ? cast<AllocaInst>(Base)->getAllocatedType()
+                : isa<GlobalVariable>(Base) ? cast<GlobalVariable>(Base)->getValueType() : nullptr;
+      if (T && T->isArrayTy())
+        Elements[i] = T->getArrayNumElements();
+      if (Elements[i] && Elements[i] * 8 < Required)
+        return LogErrorV("Array troppo corto per il parametro " + CalleeF->getArg(i)->getName() +
+                         " di " + Callee);
+      Value *Id = isa<LoadInst>(Base) ? cast<LoadInst>(Base)->getPointerOperand() : Base;
+      if (is_contained(Arrays, Id))
+        return LogErrorV("Lo stesso array è passato a due parametri array di " + Callee);
+      Arrays.push_back(Id);
+      if (isa<GlobalVariable>(Base) && !CalleeF->isDeclaration())
+        return LogErrorV("L'array globale " + Base->getName() + " non può essere passato a " + Callee +
+                         ", che può accedervi direttamente");
+    }
     if (!ArgsV.back())
       return nullptr;
   }
-  return builder->CreateCall(CalleeF, ArgsV, "calltmp");
+  // Una lunghezza a[n] costante nella chiamata non può superare gli elementi
+  // dell'array passato, se noti
+  for (Argument &A : CalleeF->args())
+  {
+    unsigned L;
+    double N;
+    Attribute Length = CalleeF->getAttributes().getParamAttr(A.getArgNo(), "kcomp-length");
+    if (Elements[A.getArgNo()] && Length.isValid() && !Length.getValueAsString().getAsInteger(10, L) &&
+        getConstant(Args[L], N) && N > Elements[A.getArgNo()])
+      return LogErrorV("Array troppo corto per la lunghezza " + CalleeF->getArg(L)->getName() +
+                       " del parametro " + A.getName() + " di " + Callee);
+  }
+  // Le funzioni di libreria note al compilatore diventano l'intrinsic
+  // corrispondente (che il back-end può tradurre in una sola istruzione e il
+  // vettorizzatore in un'operazione vettoriale) oppure una chiamata a una
+  // funzione senza effetti collaterali
+  if (B)
+  {
+    if (B->ID == Intrinsic::not_intrinsic)
+    {
+      CalleeF->setDoesNotAccessMemory();
+      CalleeF->setDoesNotThrow();
+      CalleeF->setWillReturn();
+    }
+    else
+      CalleeF = Intrinsic::getDeclaration(drv.module.get(), B->ID, {valueType(drv, Width)});
+  }
+  // Una chiamata ricorsiva in posizione di coda diventa un salto all'inizio
+  // del corpo, dopo aver assegnato ai parametri i valori degli argomenti
+  // (già tutti calcolati) e liberato gli array sul heap degli scope aperti.
+  // Il codice che seguirebbe la chiamata, fino al return, non viene più
+  // eseguito: lo si genera in un blocco irraggiungibile.
+  // Un array locale passato come argomento esclude sia la trasformazione,
+  // perché la sua memoria sarebbe riutilizzata (o liberata) dall'iterazione
+  // successiva, sia la marcatura tail, perché il chiamato accede alla memoria
+  // del chiamante
+  Function *Caller = drv.builder->GetInsertBlock()->getParent();
+  bool InTail = Tail && !LocalArray;
+  if (CalleeF == Caller && InTail && drv.TailRecurse)
+  {
+    drv.emitCleanups(0);
+    for (unsigned i = 0; i < ArgsV.size(); i++)
+      drv.builder->CreateStore(ArgsV[i], drv.Slots[i]);
+    BranchInst *Br = drv.builder->CreateBr(drv.TailRecurse);
+    drv.context->diagnose(OptimizationRemark("tailrec", "TailRecursion", Br)
+                          << "chiamata ricorsiva in coda trasformata in ciclo");
+    drv.builder->SetInsertPoint(BasicBlock::Create(*drv.context, "tailcont", Caller));
+    return PoisonValue::get(CalleeF->getReturnType());
+  }
+  // Le altre chiamate in posizione di coda sono marcate tail: senza array
+  // locali fra gli argomenti, nessuna funzione accede alle variabili locali
+  // (alloca) del chiamante
+  CallInst *Call = drv.builder->CreateCall(CalleeF, ArgsV, "calltmp");
+  if (InTail)
+    Call->setTailCall();
+  else if (CalleeF == Caller && Tail)
+    drv.context->diagnose(OptimizationRemarkMissed("tailrec", "LocalArrayArgument", Call)
+                          << "chiamata ricorsiva con un array locale come argomento: non trasformata in ciclo");
+  else if (CalleeF == Caller)
+    drv.context->diagnose(OptimizationRemarkMissed("tailrec", "NotTailPosition", Call)
+                          << "chiamata ricorsiva non in posizione di coda: non trasformata in ciclo");
+  return Call;
 }
 
-/************************* Array Expression Tree *************************/
-ArrayExprAST::ArrayExprAST(std::string Name, ExprAST *Offset) : Name(Name), Offset(Offset){};
-
-Value *ArrayExprAST::codegen(driver &drv)
+// Il risultato di una funzione del programma ha il tipo del suo prototipo;
+// un builtin della libreria matematica ha la larghezza dei suoi argomenti
+unsigned CallExprAST::vectorWidth(driver &drv)
 {
+  unsigned Width = 0;
+  if (Function *CalleeF = drv.module->getFunction(Callee))
+  {
+    if (!getBuiltin(drv, CalleeF))
+      return widthOf(CalleeF->getReturnType());
+    for (ExprAST *arg : Args)
+      Width = std::max(Width, arg->vectorWidth(drv));
+    return Width;
+  }
+  if ((Width = vectorSuffix(Callee, "vec")) || (Width = vectorSuffix(Callee, "load")))
+    return Width;
+  if (Callee == "insert" && !Args.empty())
+    return Args[0]->vectorWidth(drv);
+  if (Callee == "shuffle" && Args.size() > 1)
+    return Args.size() - (Args[1]->vectorWidth(drv) ? 2 : 1);
+  return 0;
+}
 
-  Value *doubleIndex = Offset->codegen(drv);
-  if (!doubleIndex)
+// Generazione delle operazioni predefinite sui vettori (si veda
+// isVectorBuiltin). Gli indici non costanti di extract e insert non sono
+// controllati: fuori dal vettore il risultato è indefinito
+Value *CallExprAST::codegenVector(driver &drv)
+{
+  TimeRegion Region(drv, "CallExprAST::codegenVector");
+  Type *DoubleTy = Type::getDoubleTy(*drv.context);
+  auto vector = [&](ExprAST *E) -> Value * {
+    Value *V = E->codegen(drv);
+    if (V && !V->getType()->isVectorTy())
+      return LogErrorV("La funzione " + Callee + " richiede un vettore");
+    return V;
+  };
+  if (unsigned Width = vectorSuffix(Callee, "vec"))
+  {
+    // Un solo argomento viene replicato in tutti gli elementi
+    Type *T = valueType(drv, Width);
+    if (Args.size() == 1)
+      return convertTo(drv, Args[0]->codegen(drv), T);
+    if (Args.size() != Width)
+      return LogErrorV("Numero di argomenti non corretto");
+    Value *V = PoisonValue::get(T);
+    for (unsigned i = 0; i < Width; i++)
+    {
+      Value *E = convertTo(drv, Args[i]->codegen(drv), DoubleTy);
+      if (!E)
+        return nullptr;
+      V = drv.builder->CreateInsertElement(V, E, i, "vec");
+    }
+    return V;
+  }
+  if (unsigned Width = vectorSuffix(Callee, "load"))
+  {
+    // Gli elementi consecutivi di un array sono allineati come un double
+    if (Args.size() != 2)
+      return LogErrorV("Numero di argomenti non corretto");
+    bool Local = false;
+    Value *Base = Args[0]->codegenArray(drv, Local);
+    Value *Idx = Base ? Args[1]->codegenInt(drv) : nullptr;
+    if (!Idx)
+      return nullptr;
+    Value *P = drv.builder->CreateInBoundsGEP(DoubleTy, Base, Idx);
+    return drv.builder->CreateAlignedLoad(valueType(drv, Width), P, Align(8), "vecload");
+  }
+  if (Callee == "extract" || Callee == "insert")
+  {
+    bool Insert = Callee == "insert";
+    if (Args.size() != (Insert ? 3 : 2))
+      return LogErrorV("Numero di argomenti non corretto");
+    Value *V = vector(Args[0]);
+    Value *Idx = V ? Args[1]->codegenInt(drv) : nullptr;
+    if (!Idx)
+      return nullptr;
+    double C;
+    if (getConstant(Args[1], C) && (C < 0 || C >= widthOf(V->getType())))
+      return LogErrorV("Indice fuori dal vettore in " + Callee);
+    if (!Insert)
+      return drv.builder->CreateExtractElement(V, Idx, "elem");
+    Value *X = convertTo(drv, Args[2]->codegen(drv), DoubleTy);
+    return X ? drv.builder->CreateInsertElement(V, X, Idx, "ins") : nullptr;
+  }
+  if (Callee == "shuffle")
+  {
+    if (Args.size() < 2)
+      return LogErrorV("Numero di argomenti non corretto");
+    Value *V = vector(Args[0]);
+    if (!V)
+      return nullptr;
+    bool Two = Args[1]->vectorWidth(drv);
+    Value *W = Two ? convertTo(drv, Args[1]->codegen(drv), V->getType()) : PoisonValue::get(V->getType());
+    if (!W)
+      return nullptr;
+    unsigned Elems = widthOf(V->getType()) * (Two ? 2 : 1);
+    SmallVector<int, 8> Mask;
+    for (ExprAST *E : Args.drop_front(Two ? 2 : 1))
+    {
+      double C;
+      if (!getConstant(E, C) || C < 0 || C >= Elems || C != std::floor(C))
+        return LogErrorV("Gli indici di shuffle devono essere costanti intere minori di " + Twine(Elems));
+      Mask.push_back(C);
+    }
+    if (Mask.size() != 2 && Mask.size() != 4 && Mask.size() != 8)
+      return LogErrorV("shuffle deve produrre 2, 4 o 8 elementi");
+    return drv.builder->CreateShuffleVector(V, W, Mask, "shuffle");
+  }
+  // Riduzioni orizzontali. Senza fast (reassoc) la somma e il prodotto
+  // seguono l'ordine degli elementi, come il ciclo scalare equivalente; con
+  // fast il back-end li può combinare ad albero
+  if (Args.size() != 1)
+    return LogErrorV("Numero di argomenti non corretto");
+  Value *V = vector(Args[0]);
+  if (!V)
     return nullptr;
+  if (Callee == "hsum")
+    return drv.builder->CreateFAddReduce(ConstantFP::getNegativeZero(DoubleTy), V);
+  if (Callee == "hprod")
+    return drv.builder->CreateFMulReduce(ConstantFP::get(DoubleTy, 1.0), V);
+  if (Callee == "hmin")
+    return drv.builder->CreateFPMinReduce(V);
+  return drv.builder->CreateFPMaxReduce(V);
+}
 
-  Value *floatIndex = builder->CreateFPTrunc(doubleIndex, Type::getFloatTy(*context));
-  Value *intIndex = builder->CreateFPToSI(floatIndex, Type::getInt32Ty(*context));
+/************************* Array Expression Tree *************************/
+ArrayExprAST::ArrayExprAST(StringRef Name, ExprAST *Offset) : Name(Name), Offset(Offset){};
 
-  Value *A = drv.NamedValues[Name];
-  if (!A)
+bool ArrayExprAST::resolve(driver &drv)
+{
+  if (!Offset->resolve(drv) || !drv.resolve(Name, Ref))
+    return false;
+  if (!drv.isArray(Ref))
   {
-    A = module->getNamedGlobal(Name);
-    if (!A)
-      return LogErrorV("Variabile " + Name + " non definita");
+    LogErrorV("Variabile " + Name + " non è un array");
+    return false;
   }
+  return true;
+}
+
+ExprAST *ArrayExprAST::fold(driver &drv)
+{
+  Offset = Offset->fold(drv);
+  return this;
+}
+
+void ArrayExprAST::hash(driver &drv, MD5 &H)
+{
+  hashLoc(drv, H);
+  hashValue(H, 'A');
+  hashValue(H, Name);
+  hashValue(H, Ref);
+  Offset->hash(drv, H);
+}
+
+Value *ArrayExprAST::codegen(driver &drv)
+{
+  TimeRegion Region(drv, "ArrayExprAST::codegen");
+  DebugLocation DL(drv, this);
+  Value *intIndex = Offset->codegenInt(drv);
+  if (!intIndex)
+    return nullptr;
 
-  Value *p = builder->CreateInBoundsGEP(Type::getDoubleTy(*context), A, intIndex);
-  return builder->CreateLoad(Type::getDoubleTy(*context), p, Name.c_str());
+  Value *p = drv.builder->CreateInBoundsGEP(Type::getDoubleTy(*drv.context), drv.address(Ref), intIndex);
+  return drv.builder->CreateLoad(Type::getDoubleTy(*drv.context), p, Name);
 };
 
 /************************* If Expression Tree *************************/
 IfExprAST::IfExprAST(ExprAST *Cond, ExprAST *TrueExp, ExprAST *FalseExp) : Cond(Cond), TrueExp(TrueExp), FalseExp(FalseExp){};
 
-Value *IfExprAST::codegen(driver &drv)
+bool IfExprAST::resolve(driver &drv)
 {
-  // Viene dapprima generato il codice per valutare la condizione, che
-  // memorizza il risultato (di tipo i1, dunque booleano) nel registro SSA
-  // che viene "memorizzato" in CondV.
-  Value *CondV = Cond->codegen(drv);
-  if (!CondV)
-    return nullptr;
+  return Cond->resolve(drv) && TrueExp->resolve(drv) && FalseExp->resolve(drv);
+}
+
+// Con una condizione costante resta soltanto il ramo che viene scelto
+ExprAST *IfExprAST::fold(driver &drv)
+{
+  bool C;
+  Cond = Cond->fold(drv);
+  if (getCondition(Cond, C))
+    return (C ? TrueExp : FalseExp)->fold(drv);
+  TrueExp = TrueExp->fold(drv);
+  FalseExp = FalseExp->fold(drv);
+  return this;
+}
 
-  // Ora bisogna generare l'istruzione di salto condizionato, ma prima
-  // vanno creati i corrispondenti basic block nella funzione attuale
+// Il valore del condizionale è quello di uno dei due rami
+bool IfExprAST::markTail(StringRef Caller)
+{
+  bool TrueRec = TrueExp->markTail(Caller);
+  bool FalseRec = FalseExp->markTail(Caller);
+  return TrueRec || FalseRec;
+}
+
+void IfExprAST::hash(driver &drv, MD5 &H)
+{
+  hashLoc(drv, H);
+  hashValue(H, '?');
+  Cond->hash(drv, H);
+  TrueExp->hash(drv, H);
+  FalseExp->hash(drv, H);
+}
+
+Value *IfExprAST::codegen(driver &drv)
+{
+  TimeRegion Region(drv, "IfExprAST::codegen");
+  DebugLocation DL(drv, this);
+  // Con una maschera come condizione il condizionale è una select elemento
+  // per elemento (m ? a : b): entrambi i valori sono calcolati, senza salti
+  if (unsigned Width = Cond->vectorWidth(drv))
+  {
+    Type *T = valueType(drv, Width);
+    Value *C = Cond->codegen(drv);
+    Value *TrueV = C ? convertTo(drv, TrueExp->codegen(drv), T) : nullptr;
+    Value *FalseV = TrueV ? convertTo(drv, FalseExp->codegen(drv), T) : nullptr;
+    return FalseV ? drv.builder->CreateSelect(C, TrueV, FalseV, "select") : nullptr;
+  }
+  // Il valore è un vettore se lo è uno dei due rami (l'altro, se scalare,
+  // viene replicato)
+  Type *T = valueType(drv, vectorWidth(drv));
+  // Vanno dapprima creati i basic block del condizionale nella funzione attuale
   // (ovvero la funzione di cui fa parte il corrente blocco di inserimento)
-  Function *function = builder->GetInsertBlock()->getParent();
-  BasicBlock *TrueBB = BasicBlock::Create(*context, "trueexp", function);
-  // Il blocco TrueBB viene inserito nella funzione dopo il blocco corrente
-  BasicBlock *FalseBB = BasicBlock::Create(*context, "falseexp");
-  BasicBlock *MergeBB = BasicBlock::Create(*context, "endcond");
-  // Gli altri due blocchi non vengono ancora inseriti perché le istruzioni
-  // previste nel "ramo" true del condizionale potrebbe dare luogo alla creazione
-  // di altri blocchi, che naturalmente andrebbero inseriti prima di FalseBB
-
-  // Ora possiamo crere l'istruzione di salto condizionato
-  builder->CreateCondBr(CondV, TrueBB, FalseBB);
+  Function *function = drv.builder->GetInsertBlock()->getParent();
+  BasicBlock *TrueBB = BasicBlock::Create(*drv.context, "trueexp");
+  BasicBlock *FalseBB = BasicBlock::Create(*drv.context, "falseexp");
+  BasicBlock *MergeBB = BasicBlock::Create(*drv.context, "endcond");
+  // Nessun blocco viene ancora inserito perché la valutazione della condizione
+  // e le istruzioni previste nel "ramo" true del condizionale potrebbero dare
+  // luogo alla creazione di altri blocchi, che vanno inseriti prima
+
+  // La condizione viene tradotta direttamente in salti condizionati verso
+  // TrueBB e FalseBB (con valutazione short-circuit di and e or).
+  // Il blocco TrueBB viene poi inserito dopo quelli della condizione
+  if (!Cond->codegenBranch(drv, TrueBB, FalseBB))
+    return nullptr;
+  function->insert(function->end(), TrueBB);
 
   // "Posizioniamo" il builder all'inizio del blocco true,
   // generiamo ricorsivamente il codice da eseguire in caso di
   // condizione vera e, in chiusura di blocco, generiamo il saldo
   // incondizionato al blocco merge
-  builder->SetInsertPoint(TrueBB);
-  Value *TrueV = TrueExp->codegen(drv);
+  drv.builder->SetInsertPoint(TrueBB);
+  Value *TrueV = convertTo(drv, TrueExp->codegen(drv), T);
   if (!TrueV)
     return nullptr;
-  builder->CreateBr(MergeBB);
+  drv.builder->CreateBr(MergeBB);
 
   // Come già ricordato, la chiamata di codegen in TrueExp potrebbe aver inserito
   // altri blocchi (nel caso in cui la parte trueexp sia a sua volta un condizionale).
@@ -281,29 +2512,29 @@ Value *IfExprAST::codegen(driver &drv)
   // il salto perché tale informazione verrà utilizzata da un'istruzione PHI.
   // Nel caso in cui non sia stato inserito alcun nuovo blocco, la seguente
   // istruzione corrisponde ad una NO-OP
-  TrueBB = builder->GetInsertBlock();
+  TrueBB = drv.builder->GetInsertBlock();
   function->insert(function->end(), FalseBB);
 
   // "Posizioniamo" il builder all'inizio del blocco false,
   // generiamo ricorsivamente il codice da eseguire in caso di
   // condizione falsa e, in chiusura di blocco, generiamo il saldo
   // incondizionato al blocco merge
-  builder->SetInsertPoint(FalseBB);
+  drv.builder->SetInsertPoint(FalseBB);
 
-  Value *FalseV = FalseExp->codegen(drv);
+  Value *FalseV = convertTo(drv, FalseExp->codegen(drv), T);
   if (!FalseV)
     return nullptr;
-  builder->CreateBr(MergeBB);
+  drv.builder->CreateBr(MergeBB);
 
   // Esattamente per la ragione spiegata sopra (ovvero il possibile inserimento
   // di nuovi blocchi da parte della chiamata di codegen in FalseExp), andiamo ora
   // a recuperare il blocco corrente
-  FalseBB = builder->GetInsertBlock();
+  FalseBB = drv.builder->GetInsertBlock();
   function->insert(function->end(), MergeBB);
 
   // Andiamo dunque a generare il codice per la parte dove i due "flussi"
   // di esecuzione si riuniscono. Impostiamo correttamente il builder
-  builder->SetInsertPoint(MergeBB);
+  drv.builder->SetInsertPoint(MergeBB);
 
   // Il codice di riunione dei flussi è una "semplice" istruzione PHI:
   // a seconda del blocco da cui arriva il flusso, TrueBB o FalseBB, il valore
@@ -314,64 +2545,93 @@ Value *IfExprAST::codegen(driver &drv)
   // 1) Dapprima si crea il nodo PHI specificando quanti sono i possibili nodi sorgente
   // 2) Per ogni possibile nodo sorgente, viene poi inserita l'etichetta e il registro
   //    SSA da cui prelevare il valore
-  PHINode *PN = builder->CreatePHI(Type::getDoubleTy(*context), 2, "condval");
+  PHINode *PN = drv.builder->CreatePHI(T, 2, "condval");
   PN->addIncoming(TrueV, TrueBB);
   PN->addIncoming(FalseV, FalseBB);
   return PN;
 };
 
+unsigned IfExprAST::vectorWidth(driver &drv)
+{
+  return std::max({Cond->vectorWidth(drv), TrueExp->vectorWidth(drv), FalseExp->vectorWidth(drv)});
+}
+
 /********************** Block Expression Tree *********************/
-BlockAST::BlockAST(std::vector<StmtAST *> Stmts) : Stmts(std::move(Stmts)){};
+BlockAST::BlockAST(MutableArrayRef<StmtAST *> Stmts) : Stmts(Stmts){};
+
+BlockAST::BlockAST(MutableArrayRef<BindingAST *> Def, MutableArrayRef<StmtAST *> Stmts) : Def(Def), Stmts(Stmts){};
+
+// Un blocco è un'espressione preceduta dalla definizione di una o più variabili locali.
+// Le definizioni sono opzionali e tuttavia necessarie perché l'uso di un blocco
+// abbia senso. Ad ogni variabile deve essere associato il valore di una costante o il valore di
+// un'espressione. Nell'espressione, arbitraria, possono chiaramente comparire simboli di
+// variabile. La gestione dello scope (ovvero delle regole di visibilità) è interamente
+// compito della risoluzione dei nomi: il blocco apre uno scope nella tabella dei simboli,
+// ogni definizione (var y = x+1) risolve prima la propria espressione, in cui x è ancora
+// quella visibile all'esterno, e poi registra y in un nuovo slot, che nasconde un'eventuale
+// y esterna (ad esempio un parametro) fino alla chiusura del blocco. All'uscita, il
+// distruttore di Scope rimuove i simboli del blocco e ripristina quelli nascosti
+bool BlockAST::resolve(driver &drv)
+{
+  ScopedHashTableScope<const char *, unsigned> Scope(drv.Symbols);
+  for (auto def : Def)
+    if (!def->resolve(drv))
+      return false;
+  for (auto stmt : Stmts)
+    if (!stmt->resolve(drv))
+      return false;
+  return true;
+}
 
-BlockAST::BlockAST(std::vector<BindingAST *> Def, std::vector<StmtAST *> Stmts) : Def(std::move(Def)), Stmts(std::move(Stmts)){};
+StmtAST *BlockAST::fold(driver &drv)
+{
+  for (auto &def : Def)
+    def = def->fold(drv);
+  for (auto &stmt : Stmts)
+    stmt = stmt->fold(drv);
+  return this;
+}
 
-Value *BlockAST::codegen(driver &drv)
+// Il valore del blocco è quello dell'ultimo statement
+bool BlockAST::markTail(StringRef Caller)
 {
-  // Un blocco è un'espressione preceduta dalla definizione di una o più variabili locali.
-  // Le definizioni sono opzionali e tuttavia necessarie perché l'uso di un blocco
-  // abbia senso. Ad ogni variabile deve essere associato il valore di una costante o il valore di
-  // un'espressione. Nell'espressione, arbitraria, possono chiaramente comparire simboli di
-  // variabile. Al riguardo, la gestione dello scope (ovvero delle regole di visibilità)
-  // è implementata nel modo seguente, in cui, come esempio, consideremo la definzione: var y = x+1
-  // 1) Viene dapprima generato il codice per valutare l'espressione x+1.
-  //    L'area di memoria da cui "prelevare" il valore di x è scritta in un
-  //    registro SSA che è parte della (rappresentazione interna della) istruzione alloca usata
-  //    per allocare la memoria corrispondente e che è registrata nella symbol table
-  //    Per i parametri della funzione, l'istruzione di allocazione viene generata (come già sappiamo)
-  //    dalla chiamata di codegen in FunctionAST. Per le variabili locali viene generata nel presente
-  //    contesto. Si noti, di passaggio, che tutte le istruzioni di allocazione verranno poi emesse
-  //    nell'entry block, in ordine cronologico rovesciato (rispetto alla generazione). Questo perché
-  //    la routine di utilità (CreateEntryBlockAlloca) genera sempre all'inizio del blocco.
-  // 2) Ritornando all'esempio, bisogna ora gestire l'assegnamento ad y gestendone la visibilità.
-  //    Come prima cosa viene generata l'istruzione alloca per y.
-  //    Questa deve essere inserita nella symbol table per futuri riferimenti ad y
-  //    all'interno del blocco. Tuttavia, se un'istruzione alloca per y fosse già presente nella symbol
-  //    table (nel caso y sia un parametro) bisognerebbe "rimuoverla" temporaneamente e re-inserirla
-  //    all'uscita del blocco. Questo è ciò che viene fatto dal presente codice, che utilizza
-  //    al riguardo il vettore di appoggio "AllocaTmp" (che naturalmente è un vettore di
-  //    di (puntatori ad) istruzioni di allocazione
-  std::vector<AllocaInst *> AllocaTmp;
-  if (!Def.empty())
-  {
-    for (int i = 0; i < Def.size(); i++)
-    {
-      // Per ogni definizione di variabile si genera il corrispondente codice che
-      // (in questo caso) non restituisce un registro SSA ma l'istruzione di allocazione
-      AllocaInst *boundval = Def[i]->codegen(drv);
-      if (!boundval)
-        return nullptr;
-      // Viene temporaneamente rimossa la precedente istruzione di allocazione
-      // della stessa variabile (nome) e inserita quella corrente
-      AllocaTmp.push_back(drv.NamedValues[Def[i]->getName()]);
-      drv.NamedValues[Def[i]->getName()] = boundval;
-    };
-  }
+  return !Stmts.empty() && Stmts.back()->markTail(Caller);
+}
+
+void BlockAST::hash(driver &drv, MD5 &H)
+{
+  hashLoc(drv, H);
+  hashValue(H, '{');
+  hashValue(H, Def.size());
+  for (auto def : Def)
+    def->hash(drv, H);
+  hashValue(H, Stmts.size());
+  for (auto stmt : Stmts)
+    stmt->hash(drv, H);
+}
 
-  // Ora (ed è la parte più "facile" da capire) viene generato il codice che
-  // valuta l'espressione. Eventuali riferimenti a variabili vengono risolti
-  // nella symbol table appena modificata
+Value *BlockAST::codegen(driver &drv)
+{
+  TimeRegion Region(drv, "BlockAST::codegen");
+  // Per ogni definizione di variabile si genera il corrispondente codice che
+  // (in questo caso) non restituisce un registro SSA ma l'istruzione di allocazione,
+  // registrata dal binding stesso nel proprio slot. Si noti, di passaggio, che tutte
+  // le istruzioni di allocazione verranno poi emesse nell'entry block, in ordine
+  // cronologico rovesciato (rispetto alla generazione). Questo perché la routine di
+  // utilità (CreateEntryBlockAlloca) genera sempre all'inizio del blocco.
+  // Con -g le variabili del blocco appartengono a un proprio scope lessicale
+  bool Scope = drv.DBuilder && !Def.empty() && !drv.DScopes.empty();
+  if (Scope)
+    drv.DScopes.push_back(drv.DBuilder->createLexicalBlock(drv.DScopes.back(), drv.DFile, Loc.Line, Loc.Col));
+  auto PopScope = make_scope_exit([&] { if (Scope) drv.DScopes.pop_back(); });
+  size_t Mark = drv.Cleanups.size();
+  auto PopCleanups = make_scope_exit([&] { drv.Cleanups.resize(Mark); });
+  for (auto def : Def)
+    if (!def->codegen(drv))
+      return nullptr;
 
-  // Se non ho nessuna definizione (vardefs) dovrò soltanto occuparmi degli statements
+  // Ora viene generato il codice degli statement. Eventuali riferimenti a variabili
+  // sono già stati legati ai rispettivi slot dalla risoluzione dei nomi
   Value *blockvalue;
   for (int i = 0; i < Stmts.size(); i++)
   {
@@ -379,195 +2639,529 @@ Value *BlockAST::codegen(driver &drv)
     if (!blockvalue)
       return nullptr;
   }
-  // Prima di uscire dal blocco, si ripristina lo scope esterno al costrutto
-  if (!Def.empty())
-  {
-    for (int i = 0; i < Def.size(); i++)
-    {
-      drv.NamedValues[Def[i]->getName()] = AllocaTmp[i];
-    };
-  }
+  // Gli array sul heap definiti nel blocco sono liberati all'uscita.
   // Il valore del costrutto/espressione var è ovviamente il valore (il registro SSA)
   // restituito dal codice di valutazione dell'espressione
+  drv.emitCleanups(Mark);
   return blockvalue;
 };
 
 /************************* Binding Tree *************************/
 
-void BindingAST::setName(std::string Name)
+void BindingAST::setName(StringRef Name)
 {
   this->Name = Name;
 };
 
-std::string BindingAST::getName() const
+StringRef BindingAST::getName() const
 {
   return Name;
 };
 
 /************************* Var binding Tree *************************/
-VarBindingAST::VarBindingAST(std::string Name, ExprAST *Val) : Val(Val) { setName(Name); };
+VarBindingAST::VarBindingAST(StringRef Name, ExprAST *Val) : Val(Val) { setName(Name); };
 
-AllocaInst *VarBindingAST::codegen(driver &drv)
+// L'espressione è risolta prima di registrare la variabile: in var x = x+1
+// la x a destra è quella visibile all'esterno della definizione
+bool VarBindingAST::resolve(driver &drv)
+{
+  if (Val && !Val->resolve(drv))
+    return false;
+  Slot = drv.declare(Name, Val);
+  return true;
+}
+
+BindingAST *VarBindingAST::fold(driver &drv)
+{
+  if (Val)
+    Val = Val->fold(drv);
+  return this;
+}
+
+void VarBindingAST::hash(driver &drv, MD5 &H)
 {
+  hashLoc(drv, H);
+  hashValue(H, 'v');
+  hashValue(H, Name);
+  hashValue(H, Slot);
+  hashValue(H, Val != nullptr);
+  if (Val)
+    Val->hash(drv, H);
+}
 
+AllocaInst *VarBindingAST::codegen(driver &drv)
+{
+  TimeRegion Region(drv, "VarBindingAST::codegen");
+  DebugLocation DL(drv, this);
   // Viene subito recuperato il riferimento alla funzione in cui si trova
   // il blocco corrente. Il riferimento è necessario perché lo spazio necessario
   // per memorizzare una variabile (ovunque essa sia definita, si tratti cioè
   // di un parametro oppure di una variabile locale ad un blocco espressione)
   // viene sempre riservato nell'entry block della funzione. Ricordiamo che
   // l'allocazione viene fatta tramite l'utility CreateEntryBlockAlloca
-  Function *fun = builder->GetInsertBlock()->getParent();
+  Function *fun = drv.builder->GetInsertBlock()->getParent();
 
-  // Ora viene generato il codice che definisce il valore della variabile
+  // Ora viene generato il codice che definisce il valore della variabile,
+  // come intero se la variabile è stata dedotta intera (un valore scalare
+  // assegnato a una variabile vettoriale viene replicato)
+  Type *T = drv.SlotTypes[Slot];
   Value *BoundVal;
   if (Val)
   { // Val è nullptr quando ho una definizione senza allocazione (es. Var x invece che Var x = 2)
-    BoundVal = Val->codegen(drv);
+    BoundVal = T->isIntegerTy() ? Val->codegenInt(drv) : convertTo(drv, Val->codegen(drv), T);
     if (!BoundVal) // Qualcosa è andato storto nella generazione del codice?
       return nullptr;
   }
 
-  AllocaInst *Alloca = CreateEntryBlockAlloca(fun, Name);
+  AllocaInst *Alloca = CreateEntryBlockAlloca(fun, Name, T);
   // Se tutto ok, si genera l'struzione che alloca memoria per la varibile ...
   // ... e si genera l'istruzione per memorizzarvi il valore dell'espressione,
   // ovvero il contenuto del registro BoundVal
   if (Val) // Val è nullptr quando ho una definizione senza allocazione (es. Var x invece che Var x = 2)
-    builder->CreateStore(BoundVal, Alloca);
+    drv.builder->CreateStore(BoundVal, Alloca);
+  drv.declareVariable(Alloca, Name, Loc);
   // L'istruzione di allocazione (che include il registro "puntatore" all'area di memoria
-  // allocata) viene restituita per essere inserita nella symbol table
+  // allocata) viene registrata nello slot assegnato alla variabile dalla risoluzione
+  drv.Slots[Slot] = Alloca;
   return Alloca;
 };
 
 /************************* Var binding Tree *************************/
-ArrayBindingAST::ArrayBindingAST(std::string Name, double Size) : Size(Size) { setName(Name); };
-ArrayBindingAST::ArrayBindingAST(std::string Name, double Size, std::vector<ExprAST *> Values) : Size(Size), Values(std::move(Values)) { setName(Name); };
+ArrayBindingAST::ArrayBindingAST(StringRef Name, ExprAST *Size) : Size(Size) { setName(Name); };
+ArrayBindingAST::ArrayBindingAST(StringRef Name, ExprAST *Size, MutableArrayRef<ExprAST *> Values) : Size(Size), Values(Values) { setName(Name); };
 
-AllocaInst *ArrayBindingAST::codegen(driver &drv)
+// Come per le variabili, dimensione e valori sono risolti prima di registrare
+// l'array: in var a[n] la n è quella visibile all'esterno della definizione
+bool ArrayBindingAST::resolve(driver &drv)
 {
-  if (!Values.empty() && Values.size() > Size)
-    return nullptr;
+  if (!Size->resolve(drv))
+    return false;
+  for (auto value : Values)
+    if (!value->resolve(drv))
+      return false;
+  Slot = drv.declareArray(Name);
+  return true;
+}
+
+BindingAST *ArrayBindingAST::fold(driver &drv)
+{
+  Size = Size->fold(drv);
+  for (auto &value : Values)
+    value = value->fold(drv);
+  return this;
+}
+
+void ArrayBindingAST::hash(driver &drv, MD5 &H)
+{
+  hashLoc(drv, H);
+  hashValue(H, 'a');
+  hashValue(H, Name);
+  hashValue(H, Slot);
+  Size->hash(drv, H);
+  hashValue(H, Values.size());
+  for (auto value : Values)
+    value->hash(drv, H);
+}
 
-  Function *fun = builder->GetInsertBlock()->getParent();
-  ArrayType *AT = ArrayType::get(Type::getDoubleTy(*context), Size);
-  AllocaInst *Alloca = CreateEntryBlockAlloca(fun, Name, AT);
+// Array locali più grandi (in elementi) sono allocati sul heap
+static const unsigned MaxStackArray = 8192;
 
-  std::vector<Value *> boundValues;
+// Interrompe il programma (llvm.trap) se Fail è vero. Il ramo, marcato come
+// improbabile, termina con unreachable: il codice che segue può assumere Fail
+// falso
+static void CreateTrapIf(driver &drv, Value *Fail)
+{
+  Function *function = drv.builder->GetInsertBlock()->getParent();
+  BasicBlock *TrapBB = BasicBlock::Create(*drv.context, "trap", function);
+  BasicBlock *ContBB = BasicBlock::Create(*drv.context, "cont", function);
+  drv.builder->CreateCondBr(Fail, TrapBB, ContBB,
+                            MDBuilder(*drv.context).createBranchWeights(UnlikelyWeight, LikelyWeight));
+  drv.builder->SetInsertPoint(TrapBB);
+  drv.builder->CreateIntrinsic(Intrinsic::trap, {}, {});
+  drv.builder->CreateUnreachable();
+  drv.builder->SetInsertPoint(ContBB);
+}
 
-  if (!Values.empty())
+// Un array di dimensione costante e non troppo grande è un'alloca del blocco
+// entry, come le altre variabili locali. Se la dimensione è nota solo durante
+// l'esecuzione, o supera MaxStackArray elementi, l'array è allocato sul heap
+// (malloc, o calloc se ha valori iniziali, per azzerare gli elementi restanti);
+// il suo slot ne contiene l'indirizzo e il puntatore viene registrato fra i
+// Cleanups, così che la memoria sia liberata all'uscita dal blocco.
+// Una dimensione calcolata durante l'esecuzione negativa, NaN o tale che la
+// dimensione in byte non sia rappresentabile interrompe il programma, come
+// l'esaurimento della memoria (malloc restituisce NULL)
+AllocaInst *ArrayBindingAST::codegen(driver &drv)
+{
+  TimeRegion Region(drv, "ArrayBindingAST::codegen");
+  DebugLocation DL(drv, this);
+  double N;
+  bool Fixed = getConstant(Size, N);
+  if (Fixed && (N < 0 || N != (uint64_t)N))
+    return (AllocaInst *)LogErrorV("Dimensione non valida per l'array " + Name);
+  if (!Values.empty() && (!Fixed || Values.size() > N))
+    return (AllocaInst *)LogErrorV("Troppi valori iniziali (o dimensione non costante) per l'array " + Name);
+
+  Function *fun = drv.builder->GetInsertBlock()->getParent();
+  Type *DoubleTy = Type::getDoubleTy(*drv.context);
+  if (Fixed && N <= MaxStackArray)
   {
-    for (int i = 0; i < Size; i++)
+    ArrayType *AT = ArrayType::get(DoubleTy, N);
+    AllocaInst *Alloca = CreateEntryBlockAlloca(fun, Name, AT);
+
+    std::vector<Value *> boundValues;
+
+    if (!Values.empty())
     {
-      Value *boundValue;
-      if (i >= Values.size())
-        boundValue = Constant::getNullValue(Type::getDoubleTy(*context));
-      else
+      for (int i = 0; i < N; i++)
       {
-        boundValue = Values[i]->codegen(drv);
-        if (!boundValue)
-          return nullptr;
+        Value *boundValue;
+        if (i >= Values.size())
+          boundValue = Constant::getNullValue(DoubleTy);
+        else
+        {
+          boundValue = Values[i]->codegen(drv);
+          if (!boundValue)
+            return nullptr;
+        }
+        boundValues.push_back(boundValue);
       }
-      boundValues.push_back(boundValue);
-    }
 
-    // Per ogni valore, si crea il corrispondente index come Value*, si ottiene il rispettivo GEP e si effettua la Store.
-    for (int i = 0; i < Size; i++)
-    {
-      Value *index = ConstantInt::get(*context, APInt(32, i, true));
-      Value *p = builder->CreateInBoundsGEP(Type::getDoubleTy(*context), Alloca, index);
-      builder->CreateStore(boundValues[i], p);
+      // Per ogni valore, si crea il corrispondente index come Value*, si ottiene il rispettivo GEP e si effettua la Store.
+      for (int i = 0; i < N; i++)
+      {
+        Value *index = ConstantInt::get(Type::getInt64Ty(*drv.context), i);
+        Value *p = drv.builder->CreateInBoundsGEP(DoubleTy, Alloca, index);
+        drv.builder->CreateStore(boundValues[i], p);
+      }
     }
+
+    drv.declareVariable(Alloca, Name, Loc);
+    drv.Slots[Slot] = Alloca;
+    return Alloca;
   }
 
+  Type *PtrTy = PointerType::getUnqual(*drv.context);
+  Type *Int64Ty = drv.builder->getInt64Ty();
+  Function *Alloc = Values.empty() ? drv.libFunction("malloc", FunctionType::get(PtrTy, {Int64Ty}, false))
+                                   : drv.libFunction("calloc", FunctionType::get(PtrTy, {Int64Ty, Int64Ty}, false));
+  if (!Alloc || !drv.libFunction("free", FunctionType::get(drv.builder->getVoidTy(), {PtrTy}, false)))
+    return nullptr;
+
+  // Il numero di elementi non intero è convertito con saturazione (NaN
+  // diventa 0 e va quindi controllato a parte); un numero negativo, visto
+  // come intero senza segno, fa traboccare il prodotto per 8
+  Value *Count, *Invalid = drv.builder->getFalse();
+  if (Fixed)
+    Count = drv.builder->getInt64(N);
+  else if (Size->isInteger(drv))
+    Count = Size->codegenInt(drv);
+  else if (Value *D = Size->codegen(drv))
+  {
+    Count = drv.builder->CreateIntrinsic(Intrinsic::fptosi_sat, {Int64Ty, DoubleTy}, {D});
+    Invalid = drv.builder->CreateFCmpUNO(D, D, "nansize");
+  }
+  else
+    Count = nullptr;
+  if (!Count)
+    return nullptr;
+  std::vector<Value *> boundValues;
+  for (auto value : Values)
+  {
+    boundValues.push_back(value->codegen(drv));
+    if (!boundValues.back())
+      return nullptr;
+  }
+  CallInst *Mem;
+  if (Values.empty())
+  {
+    Value *Mul = drv.builder->CreateBinaryIntrinsic(Intrinsic::umul_with_overflow, Count, drv.builder->getInt64(8));
+    CreateTrapIf(drv, drv.builder->CreateOr(Invalid, drv.builder->CreateExtractValue(Mul, 1), "badsize"));
+    // malloc(0) può restituire NULL: si chiede almeno un elemento
+    Value *Bytes = drv.builder->CreateBinaryIntrinsic(Intrinsic::umax, drv.builder->CreateExtractValue(Mul, 0),
+                                                      drv.builder->getInt64(8));
+    Mem = drv.builder->CreateCall(Alloc, {Bytes}, Name);
+  }
+  else
+    Mem = drv.builder->CreateCall(Alloc, {Count, drv.builder->getInt64(8)}, Name);
+  CreateTrapIf(drv, drv.builder->CreateIsNull(Mem, "nomem"));
+  for (unsigned i = 0; i < boundValues.size(); i++)
+    drv.builder->CreateStore(boundValues[i], drv.builder->CreateConstInBoundsGEP1_64(DoubleTy, Mem, i));
+  drv.Cleanups.push_back(Mem);
+
+  AllocaInst *Alloca = CreateEntryBlockAlloca(fun, Name, PtrTy);
+  drv.builder->CreateStore(Mem, Alloca);
+  drv.declareVariable(Alloca, Name, Loc);
+  drv.Slots[Slot] = Alloca;
   return Alloca;
 };
 
 /************************* Prototype Tree *************************/
-PrototypeAST::PrototypeAST(std::string Name, std::vector<std::string> Args) : Name(Name), Args(std::move(Args)), emitcode(true){}; // Di regola il codice viene emesso
+PrototypeAST::PrototypeAST(StringRef Name, ArrayRef<ParamDecl> Args, unsigned Width) : Name(Name), Args(Args), Width(Width){};
 
 lexval PrototypeAST::getLexVal() const
 {
-  lexval lval = Name;
+  lexval lval = Name.str();
   return lval;
 };
 
-const std::vector<std::string> &PrototypeAST::getArgs() const
+ArrayRef<ParamDecl> PrototypeAST::getArgs() const
 {
   return Args;
 };
 
-// Previene la doppia emissione del codice. Si veda il commento più avanti.
-void PrototypeAST::noemit()
+unsigned PrototypeAST::getWidth() const
+{
+  return Width;
+};
+
+void PrototypeAST::hash(driver &drv, MD5 &H)
 {
-  emitcode = false;
+  hashLoc(drv, H);
+  hashValue(H, Name);
+  hashValue(H, Width);
+  hashValue(H, Args.size());
+  for (const ParamDecl &Arg : Args)
+  {
+    hashValue(H, Arg.Name);
+    hashValue(H, Arg.Array);
+    hashValue(H, Arg.Size);
+    hashValue(H, Arg.Length);
+    hashValue(H, Arg.Width);
+  }
 };
 
 Function *PrototypeAST::codegen(driver &drv)
 {
+  TimeRegion Region(drv, "PrototypeAST::codegen");
   // Costruisce una struttura, qui chiamata FT, che rappresenta il "tipo" di una
   // funzione. Con ciò si intende a sua volta una coppia composta dal tipo
   // del risultato (valore di ritorno) e da un vettore che contiene il tipo di tutti
-  // i parametri. Si ricordi, tuttavia, che nel nostro caso l'unico tipo è double.
+  // i parametri. I valori sono double oppure vettori di double (vec2, vec4, vec8).
 
-  // Prima definiamo il vettore (qui chiamato Doubles) con il tipo degli argomenti
-  std::vector<Type *> Doubles(Args.size(), Type::getDoubleTy(*context));
+  // Prima definiamo il vettore (qui chiamato Params) con il tipo degli argomenti:
+  // double, un vettore, oppure ptr per gli array. La lunghezza di un array, se
+  // data da un parametro, deve essere un parametro double dello stesso prototipo
+  std::vector<Type *> Params;
+  for (const ParamDecl &Arg : Args)
+  {
+    if (!Arg.Length.empty() &&
+        none_of(Args, [&](const ParamDecl &P) { return P.Name == Arg.Length && !P.Array && !P.Width; }))
+      return (Function *)LogErrorV("La lunghezza dell'array " + Arg.Name + " non è un parametro di " + Name);
+    Params.push_back(Arg.Array ? (Type *)PointerType::getUnqual(*drv.context) : valueType(drv, Arg.Width));
+  }
   // Quindi definiamo il tipo (FT) della funzione
-  FunctionType *FT = FunctionType::get(Type::getDoubleTy(*context), Doubles, false);
+  FunctionType *FT = FunctionType::get(valueType(drv, Width), Params, false);
+  // Una dichiarazione extern ripetuta con lo stesso tipo è la stessa funzione;
+  // con un tipo diverso (anche rispetto a una funzione della libreria C già
+  // usata dal compilatore, come free) è un errore
+  if (Function *Old = drv.module->getFunction(Name))
+  {
+    if (Old->getFunctionType() == FT)
+      return Old;
+    return (Function *)LogErrorV("La funzione " + Name + " è già dichiarata con un altro tipo");
+  }
   // Infine definiamo una funzione (al momento senza body) del tipo creato e con il nome
   // presente nel nodo AST. ExternalLinkage vuol dire che la funzione può avere
   // visibilità anche al di fuori del modulo
-  Function *F = Function::Create(FT, Function::ExternalLinkage, Name, *module);
+  Function *F = Function::Create(FT, Function::ExternalLinkage, Name, *drv.module);
 
   // Ad ogni parametro della funzione F (che, è bene ricordare, è la rappresentazione
   // llvm di una funzione, non è una funzione C++) attribuiamo ora il nome specificato dal
   // programmatore e presente nel nodo AST relativo al prototipo
+  // Un parametro array è un puntatore valido (nonnull), allineato come un
+  // double, che non si sovrappone agli altri array accessibili alla funzione
+  // (noalias, come restrict in C): il chiamante non deve passare due volte
+  // lo stesso array, né un array globale (si veda CallExprAST::codegen). Una
+  // dimensione costante lo rende anche dereferenziabile per intero, così che
+  // le letture possano essere anticipate (ad esempio fuori dai cicli) senza
+  // controlli. Il parametro che ne contiene la lunghezza (a[n]) è registrato
+  // nell'attributo kcomp-length (la sua posizione), usato dai chiamanti e
+  // dall'header C
   unsigned Idx = 0;
   for (auto &Arg : F->args())
-    Arg.setName(Args[Idx++]);
-
-  /* Abbiamo completato la creazione del codice del prototipo.
-     Il codice può quindi essere emesso, ma solo se esso corrisponde
-     ad una dichiarazione extern. Se invece il prototipo fa parte
-     della definizione "completa" di una funzione (prototipo+body) allora
-     l'emissione viene fatta al momendo dell'emissione della funzione.
-     In caso contrario nel codice si avrebbe sia una dichiarazione
-     (come nel caso di funzione esterna) sia una definizione della stessa
-     funzione.
-  */
-  if (emitcode)
-  {
-    F->print(errs());
-    fprintf(stderr, "\n");
-  };
+  {
+    const ParamDecl &P = Args[Idx++];
+    Arg.setName(P.Name);
+    if (!P.Array)
+      continue;
+    Arg.addAttr(Attribute::NoAlias);
+    Arg.addAttr(Attribute::NonNull);
+    Arg.addAttr(Attribute::NoUndef);
+    Arg.addAttr(Attribute::getWithAlignment(*drv.context, Align(8)));
+    if (P.Size)
+      Arg.addAttr(Attribute::getWithDereferenceableBytes(*drv.context, 8 * uint64_t(P.Size)));
+    for (unsigned L = 0; L < Args.size(); L++)
+      if (!P.Length.empty() && Args[L].Name == P.Length)
+        Arg.addAttr(Attribute::get(*drv.context, "kcomp-length", std::to_string(L)));
+  }
 
+  // Il codice non viene emesso qui: l'intero modulo (dichiarazioni comprese)
+  // è emesso dal driver al termine della generazione
   return F;
 }
 
 /************************* Function Tree **************************/
 FunctionAST::FunctionAST(PrototypeAST *Proto, StmtAST *Body) : Proto(Proto), Body(Body){};
 
+// I parametri occupano gli slot 0..n-1, le variabili locali i successivi
+// nell'ordine in cui sono definite. Lo scope dei parametri si chiude al
+// termine della risoluzione del corpo, dopo la quale sono dedotti i tipi
+// degli slot
+bool FunctionAST::resolve(driver &drv)
+{
+  ScopedHashTableScope<const char *, unsigned> Scope(drv.Symbols);
+  drv.SlotTypes.clear();
+  for (const ParamDecl &Arg : Proto->getArgs())
+    Arg.Array ? drv.declareArray(Arg.Name) : Arg.Width ? drv.declareVector(Arg.Name, Arg.Width) : drv.declare(Arg.Name);
+  if (!Body->resolve(drv))
+  {
+    drv.Assignments.clear();
+    return false;
+  }
+  drv.inferTypes(Proto->getArgs().size());
+  return true;
+}
+
+void FunctionAST::hash(driver &drv, MD5 &H)
+{
+  hashLoc(drv, H);
+  hashValue(H, FMF ? *FMF : drv.opts.fast_math);
+  Proto->hash(drv, H);
+  Body->hash(drv, H);
+}
+
+// fast def abilita tutte le ottimizzazioni fast-math nella funzione,
+// strict def le esclude anche se richieste dalla linea di comando; batch def
+// genera anche la versione f_batch (si veda driver::emitBatch) e può essere
+// combinato con gli altri due (batch fast def f(x) ...)
+bool FunctionAST::addQualifier(StringRef Name)
+{
+  if (Name == "batch")
+    return !std::exchange(Batch, true);
+  if (FMF || (Name != "fast" && Name != "strict"))
+    return false;
+  FMF.emplace();
+  if (Name == "fast")
+    FMF->setFast();
+  return true;
+}
+
 Function *FunctionAST::codegen(driver &drv)
 {
+  TimeRegion Region(drv, "FunctionAST::codegen");
   // Verifica che la funzione non sia già presente nel modulo, cioò che non
   // si tenti una "doppia definizion"
   Function *function =
-      module->getFunction(std::get<std::string>(Proto->getLexVal()));
+      drv.module->getFunction(std::get<std::string>(Proto->getLexVal()));
   // Se la funzione non è già presente, si prova a definirla, innanzitutto
   // generando (ma non emettendo) il codice del prototipo
+  // (anche solo dichiarata, ad esempio free dopo un array sul heap)
   if (!function)
     function = Proto->codegen(drv);
   else
-    return nullptr;
+    return (Function *)LogErrorV("La funzione " + function->getName() + " è già definita o dichiarata");
   // Se, per qualche ragione, la definizione "fallisce" si restituisce nullptr
   if (!function)
     return nullptr;
+  // La versione batch legge ogni parametro da un array di double: una
+  // funzione con parametri array o vettoriali, o con risultato vettoriale,
+  // ne è esclusa (con --batch silenziosamente)
+  bool Scalar = !Proto->getWidth() && none_of(Proto->getArgs(), [](const ParamDecl &P) { return P.Array || P.Width; });
+  if (Batch && !Scalar)
+  {
+    LogErrorV("La funzione batch " + function->getName() + " può avere soltanto parametri e risultato double");
+    function->eraseFromParent();
+    return nullptr;
+  }
+  bool Batched = (Batch || drv.opts.batch) && Scalar;
+
+  // Le operazioni floating point della funzione ricevono i flag fast-math
+  // del suo qualificatore o, in mancanza, quelli della linea di comando.
+  // Gli attributi corrispondenti informano anche il back-end
+  FastMathFlags Flags = FMF ? *FMF : drv.opts.fast_math;
+  drv.builder->setFastMathFlags(Flags);
+  if (Flags.isFast())
+    function->addFnAttr("unsafe-fp-math", "true");
+  if (Flags.noNaNs())
+    function->addFnAttr("no-nans-fp-math", "true");
+  if (Flags.noInfs())
+    function->addFnAttr("no-infs-fp-math", "true");
+  if (Flags.noSignedZeros())
+    function->addFnAttr("no-signed-zeros-fp-math", "true");
+  if (Flags.approxFunc())
+    function->addFnAttr("approx-func-fp-math", "true");
+
+  // Prima di generare il codice, ogni riferimento a variabile nel corpo
+  // viene legato al proprio slot (o a una variabile globale). Un nome non
+  // definito fa fallire la definizione, anche se compare in un ramo che la
+  // semplificazione successiva elimina. La semplificazione dell'albero tiene
+  // conto dei flag fast-math appena impostati
+  bool Resolved;
+  {
+    TimeRegion Region(drv, "resolve");
+    Resolved = resolve(drv);
+  }
+  if (!Resolved)
+  {
+    function->eraseFromParent();
+    return nullptr;
+  }
+  drv.Slots.assign(drv.SlotTypes.size(), nullptr);
+  {
+    TimeRegion Region(drv, "fold");
+    Body = Body->fold(drv);
+  }
+
+  // Con la cache, se il codice della funzione è già stato generato (da
+  // questo o da un altro processo kcomp) viene collegato al modulo, dove
+  // prende il posto del prototipo appena creato
+  std::string CachePath;
+  if (!drv.opts.cache_dir.empty())
+  {
+    TimeRegion Region(drv, "cache");
+    MD5 H;
+    hashValue(H, drv.CacheSalt);
+    hash(drv, H);
+    CachePath = drv.cachePath(H);
+    std::string Name = function->getName().str();
+    if (drv.cacheLoad(CachePath))
+    {
+      function = drv.module->getFunction(Name);
+      if (Batched)
+        drv.emitBatch(function, Proto->Loc);
+      return function;
+    }
+  }
 
   // Altrimenti si crea un blocco di base in cui iniziare a inserire il codice
-  BasicBlock *BB = BasicBlock::Create(*context, "entry", function);
-  builder->SetInsertPoint(BB);
+  BasicBlock *BB = BasicBlock::Create(*drv.context, "entry", function);
+  drv.builder->SetInsertPoint(BB);
+
+  // Con -g la funzione riceve il suo DISubprogram, alla riga del prototipo,
+  // che è anche la posizione delle istruzioni del prologo e del return
+  DISubprogram *SP = nullptr;
+  if (drv.DBuilder)
+  {
+    SmallVector<Metadata *, 8> Types{drv.debugType(function->getReturnType())};
+    for (Argument &Arg : function->args())
+      Types.push_back(drv.debugType(Arg.getType()));
+    SP = drv.DBuilder->createFunction(
+        drv.DFile, function->getName(), StringRef(), drv.DFile, Proto->Loc.Line,
+        drv.DBuilder->createSubroutineType(drv.DBuilder->getOrCreateTypeArray(Types)), Proto->Loc.Line,
+        DINode::FlagPrototyped,
+        DISubprogram::SPFlagDefinition | (drv.opts.opt_level ? DISubprogram::SPFlagOptimized : DISubprogram::SPFlagZero));
+    function->setSubprogram(SP);
+    drv.DScopes.assign(1, SP);
+    drv.builder->SetCurrentDebugLocation(DILocation::get(*drv.context, Proto->Loc.Line, Proto->Loc.Col, SP));
+  }
+  auto ClearScopes = make_scope_exit([&] {
+    drv.builder->SetCurrentDebugLocation(DebugLoc());
+    drv.DScopes.clear();
+  });
 
   // Ora viene la parte "più delicata". Per ogni parametro formale della
-  // funzione, nella symbol table si registra una coppia in cui la chiave
-  // è il nome del parametro mentre il valore è un'istruzione alloca, generata
+  // funzione, nello slot corrispondente si registra un'istruzione alloca, generata
   // invocando l'utility CreateEntryBlockAlloca già commentata.
   // Vale comunque la pena ricordare: l'istruzione di allocazione riserva
   // spazio in memoria (nel nostro caso per un double) e scrive l'indirizzo
@@ -581,102 +3175,207 @@ Function *FunctionAST::codegen(driver &drv)
   for (auto &Arg : function->args())
   {
     // Genera l'istruzione di allocazione per il parametro corrente
-    AllocaInst *Alloca = CreateEntryBlockAlloca(function, Arg.getName());
+    AllocaInst *Alloca = CreateEntryBlockAlloca(function, Arg.getName(), Arg.getType());
     // Genera un'istruzione per la memorizzazione del parametro nell'area
     // di memoria allocata
-    builder->CreateStore(&Arg, Alloca);
-    // Registra gli argomenti nella symbol table per eventuale riferimento futuro
-    drv.NamedValues[std::string(Arg.getName())] = Alloca;
+    drv.builder->CreateStore(&Arg, Alloca);
+    drv.declareVariable(Alloca, Arg.getName(), Proto->Loc, Arg.getArgNo() + 1);
+    // Registra l'allocazione nello slot del parametro
+    drv.Slots[Arg.getArgNo()] = Alloca;
+  }
+
+  // Con --instrument l'ingresso è segnalato al runtime prima del blocco
+  // tailrecurse: una ricorsione in coda, diventata ciclo, conta come una
+  // sola chiamata
+  GlobalVariable *Site = nullptr;
+  drv.ProfileSites.clear();
+  if (drv.opts.instrument)
+  {
+    Site = drv.profileSite(function->getName(), Proto->Loc, driver::ProfileFunction);
+    drv.builder->CreateCall(drv.profileHook("__kcomp_prof_enter"), Site);
+  }
+
+  // Se il valore del corpo può essere quello di una chiamata ricorsiva, questa
+  // diventerà un salto al blocco tailrecurse, che segue la memorizzazione
+  // dei parametri (ricorsione trasformata in ciclo)
+  drv.TailRecurse = nullptr;
+  drv.Cleanups.clear();
+  if (Body->markTail(function->getName()))
+  {
+    drv.TailRecurse = BasicBlock::Create(*drv.context, "tailrecurse", function);
+    drv.builder->CreateBr(drv.TailRecurse);
+    drv.builder->SetInsertPoint(drv.TailRecurse);
   }
 
   // Ora può essere generato il codice corssipondente al body (che potrà
-  // fare riferimento alla symbol table)
-  if (Value *RetVal = Body->codegen(drv))
+  // fare riferimento agli slot). Un valore double restituito da una funzione
+  // vettoriale viene replicato
+  if (Value *RetVal = convertTo(drv, Body->codegen(drv), function->getReturnType()))
   {
     // Se la generazione termina senza errori, ciò che rimane da fare è
     // di generare l'istruzione return, che ("a tempo di esecuzione") prenderà
     // il valore lasciato nel registro RetVal
-    builder->CreateRet(RetVal);
+    if (Site)
+      drv.builder->CreateCall(drv.profileHook("__kcomp_prof_exit"), Site);
+    drv.builder->CreateRet(RetVal);
+    if (SP)
+      drv.DBuilder->finalizeSubprogram(SP);
 
     // Effettua la validazione del codice e un controllo di consistenza
-    verifyFunction(*function);
+    {
+      TimeRegion Region(drv, "verify");
+      verifyFunction(*function);
+    }
+    if (drv.Stats.Enabled)
+    {
+      drv.Stats.Functions++;
+      drv.Stats.BasicBlocks += function->size();
+      for (Instruction &I : instructions(*function))
+      {
+        drv.Stats.Instructions++;
+        drv.Stats.Allocas += isa<AllocaInst>(I);
+      }
+    }
 
-    // Emissione del codice su su stderr)
-    function->print(errs());
-    fprintf(stderr, "\n");
+    // In modalità per-function la funzione viene ottimizzata subito,
+    // mentre il resto del modulo è ancora in costruzione
+    if (drv.opts.opt_per_function)
+      drv.optimize(*function);
+    if (!CachePath.empty())
+    {
+      TimeRegion Region(drv, "cache");
+      drv.cacheStore(CachePath, *function);
+    }
+    if (Batched)
+      drv.emitBatch(function, Proto->Loc);
     return function;
   }
 
-  // Errore nella definizione. La funzione viene rimossa
+  // Errore nella definizione. La funzione viene rimossa, e con lei i siti di
+  // profilo della funzione e dei suoi cicli
   function->eraseFromParent();
+  for (GlobalVariable *S : drv.ProfileSites)
+    S->eraseFromParent();
+  drv.ProfileSites.clear();
   return nullptr;
 };
 
 /************************* GlobalVarAST **************************/
-GlobalVarAST::GlobalVarAST(const std::string Name) : Name(Name){};
-GlobalVarAST::GlobalVarAST(const std::string Name, int Size) : Name(Name), Size(Size){};
+GlobalVarAST::GlobalVarAST(StringRef Name) : Name(Name), Size(0){};
+GlobalVarAST::GlobalVarAST(StringRef Name, int Size) : Name(Name), Size(Size){};
 
 GlobalVariable *GlobalVarAST::codegen(driver &drv)
 {
+  TimeRegion Region(drv, "GlobalVarAST::codegen");
   Type *T;
   Constant *initValue;
   if (!Size)
   {
-    T = Type::getDoubleTy(*context);
-    initValue = ConstantFP::get(Type::getDoubleTy(*context), 0.0);
+    T = Type::getDoubleTy(*drv.context);
+    initValue = ConstantFP::get(Type::getDoubleTy(*drv.context), 0.0);
   }
   else
   {
-    T = ArrayType::get(Type::getDoubleTy(*context), Size);
-    // initValue = ConstantInt::get(*context, APInt(32, 0, true));
-    //initValue = Constant::getNullValue(Type::getDoubleTy(*context));
-    GlobalVariable *globVar = new GlobalVariable(*module, T, false, GlobalValue::CommonLinkage, ConstantAggregateZero::get(T), Name);
-    globVar->print(errs());
-    fprintf(stderr, "\n");
-
-    return globVar;
+    T = ArrayType::get(Type::getDoubleTy(*drv.context), Size);
+    // initValue = ConstantInt::get(*drv.context, APInt(32, 0, true));
+    //initValue = Constant::getNullValue(Type::getDoubleTy(*drv.context));
+    initValue = ConstantAggregateZero::get(T);
   }
-  GlobalVariable *globVar = new GlobalVariable(*module, T, false, GlobalValue::CommonLinkage, initValue, Name);
-
-  globVar->print(errs());
-  fprintf(stderr, "\n");
-
+  GlobalVariable *globVar = new GlobalVariable(*drv.module, T, false, GlobalValue::CommonLinkage, initValue, Name);
+  drv.Globals.try_emplace(Name.data(), globVar);
+  if (drv.DBuilder)
+    globVar->addDebugInfo(drv.DBuilder->createGlobalVariableExpression(
+        drv.DUnit, Name, Name, drv.DFile, Loc.Line, drv.debugType(T), false));
   return globVar;
 }
 
 /************************* AssignmentAST **************************/
-AssignmentAST::AssignmentAST(std::string Name, ExprAST *AssignExpr) : Name(Name), AssignExpr(AssignExpr){};
-AssignmentAST::AssignmentAST(std::string Name, ExprAST *OffsetExpr, ExprAST *AssignExpr) : Name(Name), OffsetExpr(OffsetExpr), AssignExpr(AssignExpr){};
+AssignmentAST::AssignmentAST(StringRef Name, ExprAST *AssignExpr) : Name(Name), AssignExpr(AssignExpr), OffsetExpr(nullptr){};
+AssignmentAST::AssignmentAST(StringRef Name, ExprAST *OffsetExpr, ExprAST *AssignExpr) : Name(Name), OffsetExpr(OffsetExpr), AssignExpr(AssignExpr){};
+
+// Si assegnano valori agli elementi di un array (a[i] = ...) e alle variabili
+// che non lo sono
+bool AssignmentAST::resolve(driver &drv)
+{
+  if (!AssignExpr->resolve(drv) || (OffsetExpr && !OffsetExpr->resolve(drv)) ||
+      !drv.resolve(Name, Ref))
+    return false;
+  if (drv.isArray(Ref) != (OffsetExpr != nullptr))
+  {
+    LogErrorV(OffsetExpr ? "Variabile " + Name + " non è un array" : "L'array " + Name + " non può essere assegnato");
+    return false;
+  }
+  if (!OffsetExpr)
+    drv.assign(Ref, AssignExpr);
+  return true;
+}
+
+AssignmentAST *AssignmentAST::fold(driver &drv)
+{
+  AssignExpr = AssignExpr->fold(drv);
+  if (OffsetExpr)
+    OffsetExpr = OffsetExpr->fold(drv);
+  return this;
+}
+
+void AssignmentAST::hash(driver &drv, MD5 &H)
+{
+  hashLoc(drv, H);
+  hashValue(H, '=');
+  hashValue(H, Name);
+  hashValue(H, Ref);
+  hashValue(H, OffsetExpr != nullptr);
+  if (OffsetExpr)
+    OffsetExpr->hash(drv, H);
+  AssignExpr->hash(drv, H);
+}
 
 Value *AssignmentAST::codegen(driver &drv)
 {
-  Value *A = drv.NamedValues[Name];
-  if (!A)
+  TimeRegion Region(drv, "AssignmentAST::codegen");
+  DebugLocation DL(drv, this);
+  Value *A = drv.address(Ref);
+
+  // Una variabile intera riceve il valore calcolato in i64; il valore
+  // dell'assegnamento resta comunque un double
+  if (!OffsetExpr && !Ref.Global && drv.SlotTypes[Ref.Slot]->isIntegerTy())
   {
-    A = module->getNamedGlobal(Name);
-    if (!A)
-      return LogErrorV("Variabile " + Name + " non definita");
+    Value *IntRHS = AssignExpr->codegenInt(drv);
+    if (!IntRHS)
+      return nullptr;
+    drv.builder->CreateStore(IntRHS, A);
+    return drv.builder->CreateSIToFP(IntRHS, Type::getDoubleTy(*drv.context), "conv");
   }
 
   Value *RHS = AssignExpr->codegen(drv);
   if (!RHS)
     return nullptr;
 
+  // Un vettore assegnato a un elemento di un array ne occupa N consecutivi:
+  // A[i] = v scrive A[i], ..., A[i+N-1] (allineati come un double)
   if (OffsetExpr)
   {
-    Value *doubleIndex = OffsetExpr->codegen(drv);
-    Value *floatIndex = builder->CreateFPTrunc(doubleIndex, Type::getFloatTy(*context));
-    Value *intIndex = builder->CreateFPToSI(floatIndex, Type::getInt32Ty(*context));
-    Value *p = builder->CreateInBoundsGEP(Type::getDoubleTy(*context), A, intIndex);
-    builder->CreateStore(RHS, p);
+    Value *intIndex = OffsetExpr->codegenInt(drv);
+    if (!intIndex)
+      return nullptr;
+    Value *p = drv.builder->CreateInBoundsGEP(Type::getDoubleTy(*drv.context), A, intIndex);
+    if (RHS->getType()->isVectorTy())
+      drv.builder->CreateAlignedStore(RHS, p, Align(8));
+    else
+      drv.builder->CreateStore(RHS, p);
   }
   else
-    builder->CreateStore(RHS, A);
+  {
+    RHS = convertTo(drv, RHS, Ref.Global ? Ref.Global->getValueType() : drv.SlotTypes[Ref.Slot]);
+    if (!RHS)
+      return nullptr;
+    drv.builder->CreateStore(RHS, A);
+  }
 
   return RHS;
 }
 
-const std::string &AssignmentAST::getName() const
+StringRef AssignmentAST::getName() const
 {
   return Name;
 };
@@ -684,35 +3383,86 @@ const std::string &AssignmentAST::getName() const
 /************************* IfStmtAST **************************/
 IfStmtAST::IfStmtAST(ExprAST *CondExpr, StmtAST *TrueStmt, StmtAST *ElseStmt) : CondExpr(CondExpr), TrueStmt(TrueStmt), ElseStmt(ElseStmt){};
 
-Value *IfStmtAST::codegen(driver &drv)
+bool IfStmtAST::resolve(driver &drv)
+{
+  return CondExpr->resolve(drv) && TrueStmt->resolve(drv) &&
+         (!ElseStmt || ElseStmt->resolve(drv));
+}
+
+// Con una condizione costante resta soltanto il ramo che viene scelto; un if
+// senza else con condizione falsa vale 0.0, come il codice che lo traduce
+StmtAST *IfStmtAST::fold(driver &drv)
 {
-  BasicBlock *entryBB = builder->GetInsertBlock();
+  bool C;
+  CondExpr = CondExpr->fold(drv);
+  if (getCondition(CondExpr, C))
+  {
+    if (C)
+      return TrueStmt->fold(drv);
+    if (ElseStmt)
+      return ElseStmt->fold(drv);
+    return new (drv) NumberExprAST(0.0);
+  }
+  TrueStmt = TrueStmt->fold(drv);
+  if (ElseStmt)
+    ElseStmt = ElseStmt->fold(drv);
+  return this;
+}
 
-  Value *CondV = CondExpr->codegen(drv);
-  if (!CondV)
-    return nullptr;
+bool IfStmtAST::markTail(StringRef Caller)
+{
+  bool TrueRec = TrueStmt->markTail(Caller);
+  bool ElseRec = ElseStmt && ElseStmt->markTail(Caller);
+  return TrueRec || ElseRec;
+}
+
+void IfStmtAST::hash(driver &drv, MD5 &H)
+{
+  hashLoc(drv, H);
+  hashValue(H, 'i');
+  CondExpr->hash(drv, H);
+  TrueStmt->hash(drv, H);
+  hashValue(H, ElseStmt != nullptr);
+  if (ElseStmt)
+    ElseStmt->hash(drv, H);
+}
+
+// Aggiunge a PN il valore 0.0 per ogni arco entrante nel blocco corrente che
+// non provenga da Skip. Con il codice a salti delle condizioni composte gli
+// archi che escono da un ciclo, o che saltano un if senza else, possono
+// provenire da più blocchi
+static void addZeroIncoming(driver &drv, PHINode *PN, BasicBlock *Skip = nullptr)
+{
+  Constant *Zero = Constant::getNullValue(PN->getType());
+  for (BasicBlock *Pred : predecessors(drv.builder->GetInsertBlock()))
+    if (Pred != Skip)
+      PN->addIncoming(Zero, Pred);
+}
 
-  Function *function = builder->GetInsertBlock()->getParent();
-  BasicBlock *TrueBB = BasicBlock::Create(*context, "truestmt", function);
+Value *IfStmtAST::codegen(driver &drv)
+{
+  TimeRegion Region(drv, "IfStmtAST::codegen");
+  DebugLocation DL(drv, this);
+  Function *function = drv.builder->GetInsertBlock()->getParent();
+  BasicBlock *TrueBB = BasicBlock::Create(*drv.context, "truestmt");
 
   BasicBlock *FalseBB;
   if (ElseStmt)
-    FalseBB = BasicBlock::Create(*context, "elsestmt");
+    FalseBB = BasicBlock::Create(*drv.context, "elsestmt");
 
-  BasicBlock *MergeBB = BasicBlock::Create(*context, "endstmt");
+  BasicBlock *MergeBB = BasicBlock::Create(*drv.context, "endstmt");
 
-  if (ElseStmt)
-    builder->CreateCondBr(CondV, TrueBB, FalseBB);
-  else
-    builder->CreateCondBr(CondV, TrueBB, MergeBB);
+  if (!CondExpr->codegenBranch(drv, TrueBB, ElseStmt ? FalseBB : MergeBB))
+    return nullptr;
+  function->insert(function->end(), TrueBB);
 
-  builder->SetInsertPoint(TrueBB);
+  drv.builder->SetInsertPoint(TrueBB);
   Value *TrueV = TrueStmt->codegen(drv);
   if (!TrueV)
     return nullptr;
-  builder->CreateBr(MergeBB);
+  drv.builder->CreateBr(MergeBB);
 
-  TrueBB = builder->GetInsertBlock();
+  TrueBB = drv.builder->GetInsertBlock();
   if (ElseStmt)
     function->insert(function->end(), FalseBB);
   else
@@ -721,25 +3471,35 @@ Value *IfStmtAST::codegen(driver &drv)
   Value *FalseV;
   if (ElseStmt)
   {
-    builder->SetInsertPoint(FalseBB);
+    drv.builder->SetInsertPoint(FalseBB);
 
     FalseV = ElseStmt->codegen(drv);
     if (!FalseV)
       return nullptr;
-    builder->CreateBr(MergeBB);
+    drv.builder->CreateBr(MergeBB);
 
-    FalseBB = builder->GetInsertBlock();
+    FalseBB = drv.builder->GetInsertBlock();
     function->insert(function->end(), MergeBB);
   }
 
-  builder->SetInsertPoint(MergeBB);
+  // Se uno dei due rami ha un valore vettoriale, l'altro viene replicato
+  // (prima del salto che chiude il suo blocco)
+  Type *T = TrueV->getType();
+  if (ElseStmt && !T->isVectorTy())
+    T = FalseV->getType();
+  TrueV = convertIn(drv, TrueBB, TrueV, T);
+  if (ElseStmt)
+    FalseV = convertIn(drv, FalseBB, FalseV, T);
+  if (!TrueV || (ElseStmt && !FalseV))
+    return nullptr;
+  drv.builder->SetInsertPoint(MergeBB);
 
-  PHINode *PN = builder->CreatePHI(Type::getDoubleTy(*context), 2, "condval");
+  PHINode *PN = drv.builder->CreatePHI(T, 2, "condval");
   PN->addIncoming(TrueV, TrueBB);
   if (ElseStmt)
     PN->addIncoming(FalseV, FalseBB);
   else
-    PN->addIncoming(Constant::getNullValue(Type::getDoubleTy(*context)), entryBB);
+    addZeroIncoming(drv, PN, TrueBB);
 
   return PN;
 };
@@ -753,23 +3513,182 @@ varOp VarOperation::getOp()
   return operation;
 };
 
+bool VarOperation::resolve(driver &drv)
+{
+  return std::visit([&drv](auto *op) { return op->resolve(drv); }, operation);
+};
+
+VarOperation *VarOperation::fold(driver &drv)
+{
+  std::visit([&drv](auto *&op) { op = op->fold(drv); }, operation);
+  return this;
+};
+
+void VarOperation::hash(driver &drv, MD5 &H)
+{
+  hashLoc(drv, H);
+  hashValue(H, operation.index());
+  std::visit([&drv, &H](auto *op) { op->hash(drv, H); }, operation);
+};
+
+/************************* LoopStmtAST **************************/
+
+// Arg è l'argomento numerico del suggerimento, -1 se assente
+bool LoopStmtAST::addHint(StringRef Name, int Arg)
+{
+  if (Arg == 0 || Arg < -1)
+    return false;
+  unsigned Count = Arg > 0 ? Arg : 0;
+  if (Name == "vectorize")
+  {
+    Hints.Vectorize = 1;
+    Hints.Width = Count;
+  }
+  else if (Name == "interleave")
+  {
+    Hints.Interleave = 1;
+    Hints.InterleaveCount = Count;
+  }
+  else if (Name == "unroll")
+  {
+    Hints.Unroll = 1;
+    Hints.UnrollCount = Count;
+  }
+  else if (Arg != -1)
+    return false;
+  else if (Name == "novectorize")
+    Hints.Vectorize = 0;
+  else if (Name == "nointerleave")
+    Hints.Interleave = 0;
+  else if (Name == "nounroll")
+    Hints.Unroll = 0;
+  else
+    return false;
+  return true;
+}
+
+void LoopStmtAST::hashHints(MD5 &H)
+{
+  for (int V : {Hints.Vectorize, Hints.Interleave, Hints.Unroll})
+    hashValue(H, V);
+  for (unsigned V : {Hints.Width, Hints.InterleaveCount, Hints.UnrollCount})
+    hashValue(H, V);
+}
+
+// Costruisce il loop ID (metadato llvm.loop) con i suggerimenti del ciclo;
+// nullptr se non ce ne sono. Il primo operando del nodo è il nodo stesso,
+// come richiesto da LLVM per renderlo unico
+MDNode *LoopStmtAST::loopID(driver &drv)
+{
+  LLVMContext &C = *drv.context;
+  SmallVector<Metadata *, 4> Ops{nullptr};
+  auto flag = [&](StringRef Name, bool Value) {
+    Ops.push_back(MDNode::get(C, {MDString::get(C, Name),
+                                  ConstantAsMetadata::get(ConstantInt::get(Type::getInt1Ty(C), Value))}));
+  };
+  auto count = [&](StringRef Name, unsigned Value) {
+    Ops.push_back(MDNode::get(C, {MDString::get(C, Name),
+                                  ConstantAsMetadata::get(ConstantInt::get(Type::getInt32Ty(C), Value))}));
+  };
+  if (Hints.Vectorize != -1)
+    flag("llvm.loop.vectorize.enable", Hints.Vectorize);
+  if (Hints.Width)
+    count("llvm.loop.vectorize.width", Hints.Width);
+  // #interleave senza conteggio richiede soltanto che il vettorizzatore (che
+  // effettua anche l'interleaving) intervenga, lasciandogli la scelta
+  if (Hints.Interleave == 1 && !Hints.InterleaveCount && Hints.Vectorize == -1)
+    flag("llvm.loop.vectorize.enable", true);
+  if (Hints.Interleave == 0)
+    count("llvm.loop.interleave.count", 1);
+  else if (Hints.InterleaveCount)
+    count("llvm.loop.interleave.count", Hints.InterleaveCount);
+  if (Hints.Unroll == 0)
+    Ops.push_back(MDNode::get(C, MDString::get(C, "llvm.loop.unroll.disable")));
+  else if (Hints.UnrollCount)
+    count("llvm.loop.unroll.count", Hints.UnrollCount);
+  else if (Hints.Unroll == 1)
+    Ops.push_back(MDNode::get(C, MDString::get(C, "llvm.loop.unroll.enable")));
+  if (Ops.size() == 1)
+    return nullptr;
+  MDNode *ID = MDNode::getDistinct(C, Ops);
+  ID->replaceOperandWith(0, ID);
+  return ID;
+}
+
+// Il contatore è una variabile i64 del blocco entry, come gli slot
+AllocaInst *LoopStmtAST::startTrips(driver &drv)
+{
+  if (!drv.opts.instrument_loops)
+    return nullptr;
+  AllocaInst *Trips = CreateEntryBlockAlloca(drv.builder->GetInsertBlock()->getParent(), "trips",
+                                             drv.builder->getInt64Ty());
+  drv.builder->CreateStore(drv.builder->getInt64(0), Trips);
+  return Trips;
+}
+
+void LoopStmtAST::countTrip(driver &drv, AllocaInst *Trips)
+{
+  if (Trips)
+    drv.builder->CreateStore(
+        drv.builder->CreateAdd(drv.builder->CreateLoad(drv.builder->getInt64Ty(), Trips), drv.builder->getInt64(1)),
+        Trips);
+}
+
+void LoopStmtAST::endTrips(driver &drv, AllocaInst *Trips, driver::ProfileKind Kind)
+{
+  if (!Trips)
+    return;
+  GlobalVariable *Site = drv.profileSite(drv.builder->GetInsertBlock()->getParent()->getName(), Loc, Kind);
+  drv.builder->CreateCall(drv.profileHook("__kcomp_prof_loop", true),
+                          {Site, drv.builder->CreateLoad(drv.builder->getInt64Ty(), Trips)});
+}
+
 /************************* ForStmtAST **************************/
 
 ForStmtAST::ForStmtAST(VarOperation *InitExp, ExprAST *CondExpr, AssignmentAST *AssignExpr, StmtAST *BodyStmt) : InitExp(InitExp), CondExpr(CondExpr), AssignExpr(AssignExpr), BodyStmt(BodyStmt){};
 
+// Una variabile definita nell'inizializzazione è visibile nella condizione,
+// nel corpo e nell'aggiornamento, e solo lì
+bool ForStmtAST::resolve(driver &drv)
+{
+  ScopedHashTableScope<const char *, unsigned> Scope(drv.Symbols);
+  return InitExp->resolve(drv) && CondExpr->resolve(drv) &&
+         BodyStmt->resolve(drv) && AssignExpr->resolve(drv);
+}
+
+StmtAST *ForStmtAST::fold(driver &drv)
+{
+  InitExp = InitExp->fold(drv);
+  CondExpr = CondExpr->fold(drv);
+  AssignExpr = AssignExpr->fold(drv);
+  BodyStmt = BodyStmt->fold(drv);
+  return this;
+}
+
+void ForStmtAST::hash(driver &drv, MD5 &H)
+{
+  hashLoc(drv, H);
+  hashValue(H, 'f');
+  hashHints(H);
+  InitExp->hash(drv, H);
+  CondExpr->hash(drv, H);
+  AssignExpr->hash(drv, H);
+  BodyStmt->hash(drv, H);
+}
+
 Value *ForStmtAST::codegen(driver &drv)
 {
+  TimeRegion Region(drv, "ForStmtAST::codegen");
+  DebugLocation DL(drv, this);
 
   // Setto l'insertPoint dal BB da cui stavo scrivendo prima
-  //  BasicBlock *entryBB = builder->GetInsertBlock();
-  //  builder->SetInsertPoint(entryBB);
+  //  BasicBlock *entryBB = drv.builder->GetInsertBlock();
+  //  drv.builder->SetInsertPoint(entryBB);
 
   // Generazione codice condizione per init.
   // Nell'init ci potranno essere due casi:
   //-> caso assignement -> InitExp è un assignment -> il suo codgen ritorna un Value
-  //-> caso VarBinding -> InitExp è un varBinding -> il suo codgen ritorna un AllocaInst da usare opportunamente
-  // tmpAlloca è una variabile che servirà per ripristinare lo scope esterno una volta terminato il ciclo.
-  AllocaInst *tmpAlloca;
+  //-> caso VarBinding -> InitExp è un varBinding -> il suo codgen ritorna un AllocaInst, già registrato nel suo slot
   if (InitExp->getOp().index())
   {
     // ASSIGNMENT
@@ -783,38 +3702,32 @@ Value *ForStmtAST::codegen(driver &drv)
     AllocaInst *boundval = std::get<BindingAST *>(InitExp->getOp())->codegen(drv);
     if (!boundval)
       return nullptr;
-    tmpAlloca = drv.NamedValues[std::get<BindingAST *>(InitExp->getOp())->getName()];
-    drv.NamedValues[std::get<BindingAST *>(InitExp->getOp())->getName()] = boundval;
   }
 
   // Creo i vari BB che serviranno e inserisco, nella funzione padre, quello per il controllo della condizione.
-  Function *function = builder->GetInsertBlock()->getParent();
-  BasicBlock *CondBB = BasicBlock::Create(*context, "condstmt", function);
-  BasicBlock *LoopBB = BasicBlock::Create(*context, "loopstmt");
-  BasicBlock *MergeBB = BasicBlock::Create(*context, "mergestmt");
+  Function *function = drv.builder->GetInsertBlock()->getParent();
+  BasicBlock *CondBB = BasicBlock::Create(*drv.context, "condstmt", function);
+  BasicBlock *LoopBB = BasicBlock::Create(*drv.context, "loopstmt");
+  BasicBlock *MergeBB = BasicBlock::Create(*drv.context, "mergestmt");
 
   // Dal blocco in cui sono creo un salto incodizionato verso il blocco
   // che si occuperà del calcolo della condizione e setto il punto di inserimento.
-  builder->CreateBr(CondBB);
-  builder->SetInsertPoint(CondBB);
+  AllocaInst *Trips = startTrips(drv);
+  drv.builder->CreateBr(CondBB);
+  drv.builder->SetInsertPoint(CondBB);
 
-  // Generazione codice condizione per condizione.
-  Value *condV = CondExpr->codegen(drv);
-  if (!condV)
-    return nullptr;
-
-  // Dopo aver generato il codice creo un salto condizionato.
+  // Generazione codice condizione per condizione, come salti condizionati.
   // vero -> loop body
   // falso -> mergeBB (esci dal loop)
-  builder->CreateCondBr(condV, LoopBB, MergeBB);
+  if (!CondExpr->codegenBranch(drv, LoopBB, MergeBB))
+    return nullptr;
 
-  // inserisco il codice per il controllo della condizione
-  CondBB = builder->GetInsertBlock();
+  // Il loop body segue i blocchi del controllo della condizione
   function->insert(function->end(), LoopBB);
 
   // Inizio a scrivere il loop body
   // generazione del body del loop
-  builder->SetInsertPoint(LoopBB);
+  drv.builder->SetInsertPoint(LoopBB);
   Value *loopV = BodyStmt->codegen(drv);
   if (!loopV)
     return nullptr;
@@ -824,20 +3737,21 @@ Value *ForStmtAST::codegen(driver &drv)
   if (!assignmentV)
     return nullptr;
 
-  // Salto incodizionato per il controllo della condizione
-  builder->CreateBr(CondBB);
+  // Salto incodizionato per il controllo della condizione. È il salto
+  // all'indietro del ciclo, cui sono associati i suggerimenti di ottimizzazione
+  countTrip(drv, Trips);
+  BranchInst *Latch = drv.builder->CreateBr(CondBB);
+  if (MDNode *ID = loopID(drv))
+    Latch->setMetadata(LLVMContext::MD_loop, ID);
 
   // Inserisco il codice del Merge
-  LoopBB = builder->GetInsertBlock();
+  LoopBB = drv.builder->GetInsertBlock();
   function->insert(function->end(), MergeBB);
 
-  builder->SetInsertPoint(MergeBB);
-  PHINode *PN = builder->CreatePHI(Type::getDoubleTy(*context), 1, "forval");
-  PN->addIncoming(Constant::getNullValue(Type::getDoubleTy(*context)), CondBB);
-
-  // Ripristino dello scope
-  if (!InitExp->getOp().index())
-    drv.NamedValues[std::get<BindingAST *>(InitExp->getOp())->getName()] = tmpAlloca;
+  drv.builder->SetInsertPoint(MergeBB);
+  PHINode *PN = drv.builder->CreatePHI(Type::getDoubleTy(*drv.context), 1, "forval");
+  addZeroIncoming(drv, PN);
+  endTrips(drv, Trips, driver::ProfileFor);
 
   return PN;
 };
@@ -846,49 +3760,73 @@ Value *ForStmtAST::codegen(driver &drv)
 
 WhileStmtAST::WhileStmtAST(ExprAST *CondExpr, StmtAST *BodyStmt) : CondExpr(CondExpr), BodyStmt(BodyStmt){};
 
+bool WhileStmtAST::resolve(driver &drv)
+{
+  return CondExpr->resolve(drv) && BodyStmt->resolve(drv);
+}
+
+StmtAST *WhileStmtAST::fold(driver &drv)
+{
+  CondExpr = CondExpr->fold(drv);
+  BodyStmt = BodyStmt->fold(drv);
+  return this;
+}
+
+void WhileStmtAST::hash(driver &drv, MD5 &H)
+{
+  hashLoc(drv, H);
+  hashValue(H, 'w');
+  hashHints(H);
+  CondExpr->hash(drv, H);
+  BodyStmt->hash(drv, H);
+}
+
 Value *WhileStmtAST::codegen(driver &drv)
 {
+  TimeRegion Region(drv, "WhileStmtAST::codegen");
+  DebugLocation DL(drv, this);
   // Creo i vari BB che serviranno e inserisco, nella funzione padre, quello per il controllo della condizione.
-  Function *function = builder->GetInsertBlock()->getParent();
-  BasicBlock *CondBB = BasicBlock::Create(*context, "condstmt", function);
-  BasicBlock *LoopBB = BasicBlock::Create(*context, "loopstmt");
-  BasicBlock *MergeBB = BasicBlock::Create(*context, "mergestmt");
+  Function *function = drv.builder->GetInsertBlock()->getParent();
+  BasicBlock *CondBB = BasicBlock::Create(*drv.context, "condstmt", function);
+  BasicBlock *LoopBB = BasicBlock::Create(*drv.context, "loopstmt");
+  BasicBlock *MergeBB = BasicBlock::Create(*drv.context, "mergestmt");
 
   // Dal blocco in cui sono creo un salto incodizionato verso il blocco
   // che si occuperà del calcolo della condizione e setto il punto di inserimento.
-  builder->CreateBr(CondBB);
-  builder->SetInsertPoint(CondBB);
-
-  // Generazione codice condizione per condizione.
-  Value *condV = CondExpr->codegen(drv);
-  if (!condV)
-    return nullptr;
+  AllocaInst *Trips = startTrips(drv);
+  drv.builder->CreateBr(CondBB);
+  drv.builder->SetInsertPoint(CondBB);
 
-  // Dopo aver generato il codice creo un salto condizionato.
+  // Generazione codice condizione per condizione, come salti condizionati.
   // vero -> loop body
   // falso -> mergeBB (esci dal loop)
-  builder->CreateCondBr(condV, LoopBB, MergeBB);
+  if (!CondExpr->codegenBranch(drv, LoopBB, MergeBB))
+    return nullptr;
 
-  // inserisco il codice per il controllo della condizione
-  CondBB = builder->GetInsertBlock();
+  // Il loop body segue i blocchi del controllo della condizione
   function->insert(function->end(), LoopBB);
 
   // Inizio a scrivere il loop body
   // generazione del body del loop
-  builder->SetInsertPoint(LoopBB);
+  drv.builder->SetInsertPoint(LoopBB);
   Value *loopV = BodyStmt->codegen(drv);
   if (!loopV)
     return nullptr;
 
-  // Salto incodizionato per il controllo della condizione
-  builder->CreateBr(CondBB);
+  // Salto incodizionato per il controllo della condizione. È il salto
+  // all'indietro del ciclo, cui sono associati i suggerimenti di ottimizzazione
+  countTrip(drv, Trips);
+  BranchInst *Latch = drv.builder->CreateBr(CondBB);
+  if (MDNode *ID = loopID(drv))
+    Latch->setMetadata(LLVMContext::MD_loop, ID);
 
   // Inserisco il codice del Merge
-  LoopBB = builder->GetInsertBlock();
+  LoopBB = drv.builder->GetInsertBlock();
   function->insert(function->end(), MergeBB);
 
-  builder->SetInsertPoint(MergeBB);
-  PHINode *PN = builder->CreatePHI(Type::getDoubleTy(*context), 1, "whileval");
-  PN->addIncoming(Constant::getNullValue(Type::getDoubleTy(*context)), CondBB);
+  drv.builder->SetInsertPoint(MergeBB);
+  PHINode *PN = drv.builder->CreatePHI(Type::getDoubleTy(*drv.context), 1, "whileval");
+  addZeroIncoming(drv, PN);
+  endTrips(drv, Trips, driver::ProfileWhile);
   return PN;
 };
@@ -2,20 +2,66 @@
 #define DRIVER_HPP
 /************************* IR related modules ******************************/
 #include "llvm/ADT/APFloat.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/ScopeExit.h"
+#include "llvm/ADT/ScopedHashTable.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/DIBuilder.h"
+#include "llvm/IR/DebugInfo.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
+/********************** Optimization related modules ***********************/
+#include "llvm/IR/DiagnosticHandler.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/DiagnosticPrinter.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/Regex.h"
+/************************ Target related modules ***************************/
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/StringSaver.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/VirtualFileSystem.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+#include "llvm/TargetParser/Host.h"
+/************************* Cache related modules ***************************/
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+/************************** JIT related modules ****************************/
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
 /**************** C++ modules and generic data types ***********************/
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
-#include <map>
+#include <cstring>
+#include <memory>
+#include <optional>
 #include <string>
+#include <tuple>
 #include <vector>
 #include <variant>
 
@@ -25,32 +71,277 @@ using namespace llvm;
 
 // Dichiarazione del prototipo yylex per Flex
 // Flex va proprio a cercare YY_DECL perché
-// deve espanderla (usando M4) nel punto appropriato
+// deve espanderla (usando M4) nel punto appropriato.
+// Lo scanner è rientrante, dunque yylex riceve anche il suo stato (yyscanner)
 # define YY_DECL \
-  yy::parser::symbol_type yylex (driver& drv)
+  yy::parser::symbol_type yylex (driver& drv, void* yyscanner)
 // Per il parser è sufficiente una forward declaration
 YY_DECL;
 
-// Classe che organizza e gestisce il processo di compilazione
+// Gestori dei passi e delle analisi del new pass manager di LLVM.
+// Sono creati una volta per file e condivisi fra l'ottimizzazione della
+// singola funzione (modalità per-function) e quella dell'intero modulo
+struct passes {
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+  PassInstrumentationCallbacks PIC;
+  PassBuilder PB;
+  FunctionPassManager FPM;  // Pipeline eseguita su ogni funzione (per-function)
+  ModulePassManager MPM;    // Pipeline eseguita sull'intero modulo
+  passes(int level, TargetMachine *TM, std::optional<PGOOptions> PGO);
+};
+
+// Opzioni di compilazione. Sono lette da kcomp dalla linea di comando e
+// condivise (in sola lettura) dai driver di tutti i file da compilare
+struct options
+{
+  bool trace_parsing = false;  // Abilita le tracce di debug el parser
+  bool trace_scanning = false; // Abilita le tracce di debug nello scanner
+  int opt_level = 0;           // Livello di ottimizzazione (-O0, -O1, -O2, -O3)
+  bool opt_per_function = false; // Ottimizza ogni funzione appena generata invece del modulo
+  bool print_pipeline = false; // Stampa la pipeline di passi eseguita
+  std::string emit_kind;  // Formato di uscita (obj, asm, bc, ll); vuoto = IR su stderr
+  std::string output;     // File di uscita; vuoto = derivato dal nome del sorgente
+  std::string mcpu;       // CPU target (-mcpu); "native" = CPU e feature dell'host
+  std::string reloc_model;// Modello di rilocazione (static, pic, dynamic-no-pic)
+  std::string code_model; // Modello di codice (tiny, small, kernel, medium, large)
+  std::string rpass;          // Remark dei passi che hanno trasformato il codice (-Rpass=regex)
+  std::string rpass_missed;   // Remark delle trasformazioni non riuscite (-Rpass-missed=regex)
+  std::string rpass_analysis; // Motivazioni delle decisioni dei passi (-Rpass-analysis=regex)
+  bool jit = false;       // Esegue il programma con ORC LLJIT invece di emetterlo
+  std::string jit_entry;  // Funzione da chiamare in modalità JIT
+  std::vector<double> jit_args;       // Argomenti passati alla funzione di ingresso
+  std::vector<std::string> jit_libs;  // Librerie condivise in cui risolvere gli extern
+  unsigned jobs = 1;      // Numero di file compilati in parallelo (-j)
+  std::string cache_dir;  // Directory della cache delle funzioni compilate (--cache-dir)
+  bool cache_stats = false; // Stampa i successi e i fallimenti della cache
+  bool time_report = false; // Stampa i tempi delle fasi e i contatori (--time-report)
+  std::string stats_file; // File JSON con tempi e contatori (--stats=json)
+  FastMathFlags fast_math;// Flag fast-math delle operazioni floating point (-ffast-math, ...)
+  bool debug_info = false;// Genera le informazioni di debug DWARF (-g)
+  bool instrument = false;       // Chiamate al runtime di profilo in ogni funzione (--instrument)
+  bool instrument_loops = false; // Anche contatori delle iterazioni dei cicli (--instrument=loops)
+  bool profile_generate = false; // Contatori degli archi per il profilo (-fprofile-generate)
+  std::string profile_raw;       // Profilo grezzo scritto dal programma; vuoto = default.profraw
+  std::string profile_use;       // Profilo indicizzato che guida l'ottimizzazione (-fprofile-use)
+  bool batch = false;            // Versione f_batch di ogni funzione con soli parametri double (--batch)
+  bool batch_threads = false;    // Anche la versione multithread f_batch_mt (--batch-threads)
+  std::string header;            // Header C con le dichiarazioni del modulo (--header=file.h)
+  bool builtins = true;   // Riconosce le funzioni matematiche note (-fno-builtin)
+  std::vector<std::string> no_builtins; // Funzioni escluse con -fno-builtin-<nome>
+};
+
+// Riferimento a una variabile, fissato dalla risoluzione dei nomi prima della
+// generazione del codice: uno slot della funzione corrente oppure una globale
+struct VarRef {
+  int Slot = -1;
+  GlobalVariable *Global = nullptr;
+};
+
+// Posizione nel sorgente (riga e colonna, a partire da 1) del primo token
+// della produzione che ha creato un nodo AST; 0 se il nodo è stato creato
+// dalla semplificazione
+struct SourceLoc {
+  unsigned Line = 0;
+  unsigned Col = 0;
+};
+
+// Parametro di una funzione: un double oppure un array, passato come double*
+// (a[]). Di un array può essere indicata la lunghezza: costante (a[8]) oppure
+// contenuta in un altro parametro della stessa funzione (a[n])
+struct ParamDecl {
+  StringRef Name;
+  bool Array = false;
+  unsigned Size = 0;  // Numero di elementi, se costante (altrimenti 0)
+  StringRef Length;   // Parametro con il numero di elementi (a[n])
+  unsigned Width = 0; // Elementi di un parametro vettoriale (x: vec4), 0 per double
+};
+
+// Suggerimenti di ottimizzazione di un ciclo (#vectorize, #unroll, ...),
+// tradotti in metadati llvm.loop sul salto all'indietro del ciclo.
+// Per ogni trasformazione: -1 = nessuna indicazione, 0 = disabilitata,
+// 1 = richiesta; il conteggio (larghezza, copie, fattore) vale 0 se libero
+struct LoopHints {
+  int Vectorize = -1;
+  unsigned Width = 0;
+  int Interleave = -1;
+  unsigned InterleaveCount = 0;
+  int Unroll = -1;
+  unsigned UnrollCount = 0;
+};
+
+// Statistiche della compilazione (--time-report, --stats=json): tempi delle
+// fasi e dei metodi di generazione del codice, contatori. I tempi sono
+// esclusivi: mentre è aperta una regione annidata (lo scanner durante il
+// parsing, un'espressione durante la generazione di un'istruzione) il tempo
+// è attribuito soltanto a quella. Successi e fallimenti della cache sono
+// contati sempre, il resto solo se Enabled
+struct statistics
+{
+  struct timing {
+    double Seconds = 0;
+    uint64_t Count = 0;
+  };
+  bool Enabled = false;
+  MapVector<const char*, timing> Timings; // Per nome della regione (un letterale)
+  const char *Current = nullptr;          // Regione aperta più interna
+  std::chrono::steady_clock::time_point Last; // Ultimo ingresso o uscita da una regione
+  uint64_t Tokens = 0;          // Token restituiti dallo scanner
+  uint64_t Nodes = 0;           // Nodi AST allocati
+  MapVector<const char*, uint64_t> NodeClasses; // Nodi AST per nome della classe
+  uint64_t ArenaBytes = 0;      // Byte allocati nell'arena dell'AST
+  uint64_t Lookups = 0;         // Ricerche nella tabella dei simboli
+  uint64_t Functions = 0;       // Funzioni generate (escluse quelle lette dalla cache)
+  uint64_t BasicBlocks = 0;     // Blocchi di base generati
+  uint64_t Instructions = 0;    // Istruzioni generate, prima dell'ottimizzazione
+  uint64_t Allocas = 0;         // Istruzioni alloca generate
+  uint64_t OptInstructions = 0; // Istruzioni del modulo ottimizzato
+  unsigned CacheHits = 0, CacheMisses = 0;
+  void merge(const statistics& S);       // Somma le statistiche di un altro file
+  void print(raw_ostream& OS) const;     // Tabella di --time-report
+  void printJSON(raw_ostream& OS) const; // Documento di --stats=json
+};
+
+// Classe che organizza e gestisce il processo di compilazione di un file.
+// Ogni driver possiede il proprio contesto LLVM, il proprio modulo e il
+// proprio builder: driver diversi possono quindi lavorare in thread diversi
 class driver
 {
 public:
-  driver();
-  std::map<std::string, AllocaInst*> NamedValues; // Tabella associativa in cui ogni 
-            // chiave x è una variabile e il cui corrispondente valore è un'istruzione 
-            // che alloca uno spazio di memoria della dimensione necessaria per 
-            // memorizzare un variabile del tipo di x (nel nostro caso solo double)
-  RootAST* root;      // A fine parsing "punta" alla radice dell'AST
+  driver(const options& opts);
+  ~driver();
+  const options& opts;
+  std::unique_ptr<LLVMContext> context;
+  std::unique_ptr<Module> module;
+  std::unique_ptr<IRBuilder<>> builder;
+  // Tabella dei simboli usata dalla risoluzione dei nomi. Le chiavi sono i
+  // puntatori agli identificatori internati dallo scanner (uguali se e solo se
+  // i nomi sono uguali), i valori gli slot delle variabili della funzione
+  // corrente. Ogni scope è un ScopedHashTableScope: apertura e chiusura
+  // costano O(1) per simbolo e ripristinano da sole le variabili nascoste
+  ScopedHashTable<const char*, unsigned> Symbols;
+  DenseMap<const char*, GlobalVariable*> Globals; // Variabili globali definite
+  std::vector<Type*> SlotTypes;   // Tipo di ogni slot: double, i64 (contatori), vettore o ptr (array)
+  // Valori assegnati agli slot: slot, valore, vero per l'inizializzazione
+  std::vector<std::tuple<unsigned, ExprAST*, bool>> Assignments;
+  std::vector<AllocaInst*> Slots; // Istruzione alloca di ogni slot (codegen)
+  BasicBlock *TailRecurse = nullptr; // Inizio del corpo, destinazione delle chiamate ricorsive in coda
+  unsigned declare (StringRef Name, ExprAST *Init = nullptr); // Nuovo slot nello scope corrente
+  unsigned declareArray (StringRef Name);        // Nuovo slot di un array
+  unsigned declareVector (StringRef Name, unsigned Width); // Nuovo slot di un parametro vettoriale
+  bool isArray (const VarRef& Ref);              // La variabile legata è un array
+  bool resolve (StringRef Name, VarRef& Ref);    // Lega un riferimento al suo slot
+  void assign (const VarRef& Ref, ExprAST *Val); // Registra un assegnamento allo slot
+  void inferTypes (unsigned Params);             // Deduce quali slot sono vettori o interi
+  Value *address (const VarRef& Ref);            // Indirizzo della variabile legata
+  // Array allocati sul heap negli scope aperti (puntatori restituiti da malloc),
+  // da liberare all'uscita dallo scope o prima di una ricorsione in coda
+  std::vector<Value*> Cleanups;
+  void emitCleanups (size_t From);               // Libera gli array da Cleanups[From] in poi
+  Function *libFunction (StringRef Name, FunctionType *FT); // Funzione della libreria C (malloc, free, ...)
   int parse (const std::string& f);
   std::string file;
-  bool trace_parsing; // Abilita le tracce di debug el parser
-  void scan_begin (); // Implementata nello scanner
+  bool scan_begin (); // Implementata nello scanner (falso se il file non si apre)
   void scan_end ();   // Implementata nello scanner
-  bool trace_scanning;// Abilita le tracce di debug nello scanner
+  void* scanner;      // Stato dello scanner (rientrante)
   yy::location location; // Utillizata dallo scannar per localizzare i token
-  void codegen();
+  std::string listing;   // IR testuale, raccolto qui invece che su stderr con -j
+  BumpPtrAllocator arena;  // Memoria dei nodi AST, liberata in blocco dopo la
+                           // generazione di ogni definizione di primo livello
+  std::vector<RootAST*> NewNodes; // Nodi nell'arena, da contare per classe (statistiche)
+  void releaseAST ();             // Conta i nodi dell'arena e la svuota
+  char *input = nullptr;     // Sorgente mappato in memoria (nullptr se letto con stdio)
+  size_t input_size = 0;     // Dimensione della mappatura (file più due byte nulli)
+  BumpPtrAllocator strarena; // Memoria degli identificatori letti con stdio
+  DenseSet<StringRef> identifiers; // Una sola occorrenza per ogni identificatore
+  StringRef intern (StringRef Id); // Occorrenza unica dell'identificatore Id
+  template <typename T> MutableArrayRef<T> copy(const std::vector<T>& v);
+  std::unique_ptr<TargetMachine> target;
+  std::unique_ptr<passes> optimizer;
+  std::string CacheSalt;      // Hash di compilatore, target e opzioni (--cache-dir)
+  statistics Stats;           // Tempi e contatori (--time-report, --stats=json)
+  std::unique_ptr<DIBuilder> DBuilder; // Informazioni di debug (-g), altrimenti nullptr
+  DICompileUnit *DUnit = nullptr;
+  DIFile *DFile = nullptr;
+  std::vector<DIScope*> DScopes;  // Scope di debug aperti: funzione e blocchi
+  DIType *debugType(Type *T);     // Tipo DWARF corrispondente a un tipo IR
+  // Descrive al debugger la variabile Name, memorizzata in A (ArgNo > 0 per i parametri)
+  void declareVariable(AllocaInst *A, StringRef Name, SourceLoc Loc, unsigned ArgNo = 0);
+  // Tipo dei siti di profilo, uguale a quello del runtime kruntime.cpp
+  enum ProfileKind { ProfileFunction, ProfileFor, ProfileWhile };
+  // Descrittore costante di un sito (funzione o ciclo) passato al runtime (--instrument)
+  GlobalVariable *profileSite(StringRef Name, SourceLoc Loc, ProfileKind Kind);
+  std::vector<GlobalVariable*> ProfileSites; // Siti della funzione in generazione
+  FunctionCallee profileHook(StringRef Name, bool Trips = false); // Funzione del runtime
+  // Genera f_batch (e con --batch-threads f_batch_mt), che applicano F a interi vettori
+  Function *emitBatch(Function *F, SourceLoc Loc);
+  void initCache();
+  std::string cachePath(MD5& H);          // File della cache per la chiave H
+  bool cacheLoad(const std::string& Path); // Collega al modulo la funzione in cache
+  void cacheStore(const std::string& Path, Function& F); // Salva la funzione
+  void codegen(RootAST* top); // Generazione di una definizione di primo livello
+  int codegen();              // Ottimizzazione ed emissione a fine parsing
+  void optimize(Function &F); // Ottimizzazione di una singola funzione
+  void optimize();            // Ottimizzazione dell'intero modulo
+  int emit();                 // Emissione del modulo nel formato richiesto
+  int writeHeader();          // Header C delle funzioni e delle globali (--header)
+  int execute();              // Esecuzione JIT della funzione di ingresso
+};
+
+// Copia nell'arena gli elementi di un vettore costruito dal parser
+template <typename T> MutableArrayRef<T> driver::copy(const std::vector<T>& v)
+{
+  T *mem = arena.Allocate<T>(v.size());
+  std::uninitialized_copy(v.begin(), v.end(), mem);
+  return MutableArrayRef<T>(mem, v.size());
+}
+
+// Regione di codice misurata: il tempo che trascorre fra costruzione e
+// distruzione è attribuito alla regione Name (si veda statistics). Ingresso e
+// uscita costano una lettura dell'orologio ciascuno; se la misura dei tempi
+// non è abilitata la regione non fa nulla
+class TimeRegion
+{
+  statistics *S = nullptr;
+  const char *Parent;
+  void charge()
+  {
+    auto Now = std::chrono::steady_clock::now();
+    if (S->Current)
+      S->Timings[S->Current].Seconds += std::chrono::duration<double>(Now - S->Last).count();
+    S->Last = Now;
+  }
+public:
+  TimeRegion(driver& drv, const char *Name)
+  {
+    if (!drv.Stats.Enabled)
+      return;
+    S = &drv.Stats;
+    charge();
+    Parent = S->Current;
+    S->Current = Name;
+    S->Timings[Name].Count++;
+  }
+  ~TimeRegion()
+  {
+    if (!S)
+      return;
+    charge();
+    S->Current = Parent;
+  }
 };
 
+// Lo scanner rientrante riceve il proprio stato come parametro aggiuntivo;
+// il parser invece conosce solo il driver, che lo stato lo memorizza
+inline yy::parser::symbol_type yylex (driver& drv)
+{
+  TimeRegion Region(drv, "scanner");
+  drv.Stats.Tokens++;
+  return yylex (drv, drv.scanner);
+}
+
 typedef std::variant<std::string,double> lexval;
 const lexval NONE = 0.0;
 
@@ -59,39 +350,92 @@ typedef std::variant<BindingAST*,AssignmentAST*> varOp;
 
 
 // Classe base dell'intera gerarchia di classi che rappresentano
-// gli elementi del programma
+// gli elementi del programma. I nodi sono allocati nell'arena del driver
+// (new (drv) NodoAST(...)) e non vengono mai distrutti singolarmente: la
+// memoria è rilasciata tutta insieme quando l'arena viene svuotata. Per questo
+// i nodi contengono solo dati che non richiedono distruzione (puntatori,
+// StringRef e ArrayRef anch'essi nell'arena del driver)
 class RootAST {
+protected:
+  void hashLoc(driver& drv, MD5& H); // Aggiunge ad H la posizione (solo con -g)
 public:
+  // Posizione impostata dal parser prima di ogni azione (si veda parser.yy)
+  // e assegnata ai nodi creati dall'azione
+  static thread_local SourceLoc NextLoc;
+  SourceLoc Loc = NextLoc;
+  void *operator new(size_t size, driver& drv);
+  void operator delete(void *, driver&) {};
+  void operator delete(void *) {};
   virtual ~RootAST() {};
+  virtual const char *className() const = 0; // Nome della classe (statistiche)
   virtual lexval getLexVal() const {return NONE;};
   virtual Value *codegen(driver& drv) { return nullptr; };
+  // Risoluzione dei nomi: lega ogni riferimento a variabile al suo slot.
+  // Restituisce false (dopo aver segnalato l'errore) se un nome non è definito
+  virtual bool resolve(driver& drv) { return true; };
+  // Semplificazione (constant folding): restituisce il nodo che sostituisce
+  // questo nell'albero, che può essere il nodo stesso o uno nuovo
+  virtual RootAST *fold(driver& drv) { return this; };
+  // Aggiunge ad H il contenuto del nodo (chiave della cache delle funzioni).
+  // Va chiamata dopo la risoluzione dei nomi e la semplificazione
+  virtual void hash(driver& drv, MD5& H) {};
 };
 
-// Classe che rappresenta la sequenza di statement
-class SeqAST : public RootAST {
-private:
-  RootAST* first;
-  RootAST* continuation;
-
+// Posizione di debug delle istruzioni generate per un nodo: finché l'oggetto
+// esiste il builder associa loro la posizione del nodo, poi torna a quella
+// precedente (quella del nodo genitore). Senza -g, o per i nodi senza
+// posizione, non fa nulla
+class DebugLocation {
+  driver *drv = nullptr;
+  DebugLoc Saved;
 public:
-  SeqAST(RootAST* first, RootAST* continuation);
-  Value *codegen(driver& drv) override;
+  DebugLocation(driver& drv, const RootAST *Node);
+  ~DebugLocation();
 };
 
 /// StmtAST - Classe base per tutti i nodi statement
-class StmtAST : public RootAST {};
+class StmtAST : public RootAST {
+public:
+  StmtAST *fold(driver& drv) override { return this; };
+  // Segnala al nodo che il suo valore è restituito dalla funzione Caller
+  // (posizione di coda). Restituisce true se vi compare una chiamata a Caller
+  virtual bool markTail(StringRef Caller) { return false; };
+};
 
 /// ExprAST - Classe base per tutti i nodi espressione
-class ExprAST : public StmtAST {};
+class ExprAST : public StmtAST {
+public:
+  // Vero se l'espressione ha sempre valore intero (costanti intere, variabili
+  // intere e loro somme e differenze): può allora essere calcolata in i64
+  virtual bool isInteger(driver& drv) { return false; };
+  // Vero se l'espressione è x + c, c + x o x - c, con x la variabile nello
+  // slot Slot e c una costante intera: il passo di una variabile di induzione
+  virtual bool isStep(unsigned Slot) { return false; };
+  // Genera il valore dell'espressione come intero i64 (indici, contatori)
+  virtual Value *codegenInt(driver& drv);
+  // Genera il codice di una condizione come salto a TrueBB o FalseBB.
+  // Hint vale 1 se la condizione è probabilmente vera, -1 se probabilmente falsa
+  virtual bool codegenBranch(driver& drv, BasicBlock *TrueBB, BasicBlock *FalseBB, int Hint = 0);
+  // Genera l'indirizzo dell'array denotato dall'espressione, passato a un
+  // parametro array. Local diventa true se l'array appartiene alla funzione
+  // chiamante (non è un parametro né una variabile globale)
+  virtual Value *codegenArray(driver& drv, bool& Local);
+  // Numero di elementi del valore se è un vettore (vec2, vec4, vec8) o una
+  // maschera prodotta dal loro confronto, 0 se è uno scalare
+  virtual unsigned vectorWidth(driver& drv) { return 0; };
+  ExprAST *fold(driver& drv) override { return this; };
+};
 
 /// BindingAST - Classe base per tutti i nodi binding
 class BindingAST : public RootAST {
 protected:
-  std::string Name;
-  void setName(std::string Name);
+  StringRef Name;
+  unsigned Slot;  // Slot assegnato dalla risoluzione dei nomi
+  void setName(StringRef Name);
 public:
   AllocaInst *codegen(driver& drv) { return nullptr; };
-  std::string getName() const;
+  BindingAST *fold(driver& drv) override { return this; };
+  StringRef getName() const;
 };
 
 /// NumberExprAST - Classe per la rappresentazione di costanti numeriche
@@ -100,20 +444,46 @@ private:
   double Val;
   
 public:
+  const char *className() const override { return "NumberExprAST"; };
   NumberExprAST(double Val);
   lexval getLexVal() const override;
+  bool isInteger(driver& drv) override;
+  void hash(driver& drv, MD5& H) override;
+  Value *codegen(driver& drv) override;
+  Value *codegenInt(driver& drv) override;
+};
+
+/// BoolExprAST - Classe per le condizioni costanti, prodotte dalla semplificazione
+class BoolExprAST : public ExprAST {
+private:
+  bool Val;
+
+public:
+  const char *className() const override { return "BoolExprAST"; };
+  BoolExprAST(bool Val);
+  lexval getLexVal() const override;
+  void hash(driver& drv, MD5& H) override;
   Value *codegen(driver& drv) override;
 };
 
 /// VariableExprAST - Classe per la rappresentazione di riferimenti a variabili
 class VariableExprAST : public ExprAST {
 private:
-  std::string Name;
+  StringRef Name;
+  VarRef Ref;
   
 public:
-  VariableExprAST(const std::string &Name);
+  const char *className() const override { return "VariableExprAST"; };
+  VariableExprAST(StringRef Name);
   lexval getLexVal() const override;
+  const VarRef& getRef() const { return Ref; };
+  bool resolve(driver& drv) override;
+  void hash(driver& drv, MD5& H) override;
+  bool isInteger(driver& drv) override;
   Value *codegen(driver& drv) override;
+  Value *codegenInt(driver& drv) override;
+  Value *codegenArray(driver& drv, bool& Local) override;
+  unsigned vectorWidth(driver& drv) override;
 };
 
 /// BinaryExprAST - Classe per la rappresentazione di operatori binari
@@ -122,32 +492,55 @@ private:
   char Op;
   ExprAST* LHS;
   ExprAST* RHS;
+  Value *codegenVector(driver& drv, unsigned Width);
 
 public:
+  const char *className() const override { return "BinaryExprAST"; };
   BinaryExprAST(char Op, ExprAST* LHS, ExprAST* RHS = nullptr);
+  bool resolve(driver& drv) override;
+  bool isInteger(driver& drv) override;
+  bool isStep(unsigned Slot) override;
+  unsigned vectorWidth(driver& drv) override;
   Value *codegen(driver& drv) override;
+  Value *codegenInt(driver& drv) override;
+  bool codegenBranch(driver& drv, BasicBlock *TrueBB, BasicBlock *FalseBB, int Hint) override;
+  ExprAST *fold(driver& drv) override;
+  void hash(driver& drv, MD5& H) override;
 };
 
 /// CallExprAST - Classe per la rappresentazione di chiamate di funzione
 class CallExprAST : public ExprAST {
 private:
-  std::string Callee;
-  std::vector<ExprAST*> Args;  // ASTs per la valutazione degli argomenti
+  StringRef Callee;
+  MutableArrayRef<ExprAST*> Args;  // ASTs per la valutazione degli argomenti
+  bool Tail = false;               // Chiamata in posizione di coda
+  Value *codegenVector(driver& drv);
 
 public:
-  CallExprAST(std::string Callee, std::vector<ExprAST*> Args);
+  const char *className() const override { return "CallExprAST"; };
+  CallExprAST(StringRef Callee, MutableArrayRef<ExprAST*> Args);
   lexval getLexVal() const override;
+  bool resolve(driver& drv) override;
+  ExprAST *fold(driver& drv) override;
+  void hash(driver& drv, MD5& H) override;
+  bool markTail(StringRef Caller) override;
+  unsigned vectorWidth(driver& drv) override;
   Value *codegen(driver& drv) override;
 };
 
 /// ArrayExprAST - Classe per la rappresentazione di array
 class ArrayExprAST : public ExprAST {
 private:
-  const std::string Name;
+  StringRef Name;
   ExprAST* Offset;
+  VarRef Ref;
 
 public:
-  ArrayExprAST(const std::string Name, ExprAST* Offset);
+  const char *className() const override { return "ArrayExprAST"; };
+  ArrayExprAST(StringRef Name, ExprAST* Offset);
+  bool resolve(driver& drv) override;
+  ExprAST *fold(driver& drv) override;
+  void hash(driver& drv, MD5& H) override;
   Value *codegen(driver& drv) override;
 };
 
@@ -158,18 +551,29 @@ private:
   ExprAST* TrueExp;
   ExprAST* FalseExp;
 public:
+  const char *className() const override { return "IfExprAST"; };
   IfExprAST(ExprAST* Cond, ExprAST* TrueExp, ExprAST* FalseExp);
+  bool resolve(driver& drv) override;
+  ExprAST *fold(driver& drv) override;
+  void hash(driver& drv, MD5& H) override;
+  bool markTail(StringRef Caller) override;
+  unsigned vectorWidth(driver& drv) override;
   Value *codegen(driver& drv) override;
 };
 
 /// BlockAST
 class BlockAST : public StmtAST {
 private:
-  std::vector<BindingAST*> Def;
-  std::vector<StmtAST*> Stmts;
+  MutableArrayRef<BindingAST*> Def;
+  MutableArrayRef<StmtAST*> Stmts;
 public:
-  BlockAST(std::vector<BindingAST*> Def, std::vector<StmtAST*> Stmts);
-  BlockAST(std::vector<StmtAST*> Stmts);
+  const char *className() const override { return "BlockAST"; };
+  BlockAST(MutableArrayRef<BindingAST*> Def, MutableArrayRef<StmtAST*> Stmts);
+  BlockAST(MutableArrayRef<StmtAST*> Stmts);
+  bool resolve(driver& drv) override;
+  StmtAST *fold(driver& drv) override;
+  void hash(driver& drv, MD5& H) override;
+  bool markTail(StringRef Caller) override;
   Value *codegen(driver& drv) override;
 }; 
 
@@ -178,36 +582,46 @@ class VarBindingAST: public BindingAST {
 private:
   ExprAST* Val;
 public:
-  VarBindingAST(const std::string Name, ExprAST* Val);
+  const char *className() const override { return "VarBindingAST"; };
+  VarBindingAST(StringRef Name, ExprAST* Val);
+  bool resolve(driver& drv) override;
+  BindingAST *fold(driver& drv) override;
+  void hash(driver& drv, MD5& H) override;
   AllocaInst *codegen(driver& drv) override;
 };
 
 //ArrayBindingAST
 class ArrayBindingAST: public BindingAST {
 private:
-  double Size;
-  std::vector<ExprAST*> Values;
+  ExprAST* Size;  // Numero di elementi: costante oppure calcolato durante l'esecuzione
+  MutableArrayRef<ExprAST*> Values;
 public:
-  ArrayBindingAST(const std::string Name, double Size);
-  ArrayBindingAST(const std::string Name, double Size, std::vector<ExprAST*> Values);
+  const char *className() const override { return "ArrayBindingAST"; };
+  ArrayBindingAST(StringRef Name, ExprAST* Size);
+  ArrayBindingAST(StringRef Name, ExprAST* Size, MutableArrayRef<ExprAST*> Values);
+  bool resolve(driver& drv) override;
+  BindingAST *fold(driver& drv) override;
+  void hash(driver& drv, MD5& H) override;
   AllocaInst *codegen(driver& drv) override;
 };
 
 /// PrototypeAST - Classe per la rappresentazione dei prototipi di funzione
-/// (nome, numero e nome dei parametri; in questo caso il tipo è implicito
-/// perché unico)
+/// (nome, numero e nome dei parametri; il tipo di un parametro è double
+/// oppure, per gli array, puntatore a double)
 class PrototypeAST : public RootAST {
 private:
-  std::string Name;
-  std::vector<std::string> Args;
-  bool emitcode;
+  StringRef Name;
+  ArrayRef<ParamDecl> Args;
+  unsigned Width;  // Elementi del risultato vettoriale, 0 per double
 
 public:
-  PrototypeAST(std::string Name, std::vector<std::string> Args);
-  const std::vector<std::string> &getArgs() const;
+  const char *className() const override { return "PrototypeAST"; };
+  PrototypeAST(StringRef Name, ArrayRef<ParamDecl> Args, unsigned Width = 0);
+  ArrayRef<ParamDecl> getArgs() const;
+  unsigned getWidth() const;
   lexval getLexVal() const override;
+  void hash(driver& drv, MD5& H) override;
   Function *codegen(driver& drv) override;
-  void noemit();
 };
 
 /// FunctionAST - Classe che rappresenta la definizione di una funzione
@@ -216,34 +630,46 @@ private:
   PrototypeAST* Proto;
   StmtAST* Body;
   bool external;
+  std::optional<FastMathFlags> FMF; // Semantica floating point scelta con fast/strict
+  bool Batch = false;               // Qualificatore batch: genera anche f_batch
   
 public:
+  const char *className() const override { return "FunctionAST"; };
   FunctionAST(PrototypeAST* Proto, StmtAST* Body);
+  bool addQualifier(StringRef Name);
+  bool resolve(driver& drv) override;
+  void hash(driver& drv, MD5& H) override;
   Function *codegen(driver& drv) override;
 };
 
 class GlobalVarAST : public RootAST {
   private:
-    const std::string Name;
+    StringRef Name;
     int Size;
   public:
-    GlobalVarAST(const std::string Name);
-    GlobalVarAST(const std::string Name, int Size);
+    const char *className() const override { return "GlobalVarAST"; };
+    GlobalVarAST(StringRef Name);
+    GlobalVarAST(StringRef Name, int Size);
     GlobalVariable *codegen(driver& drv) override;
 };
 
 //AssignmentAST classe per gli assignment
 class AssignmentAST : public StmtAST {
 private:
-  const std::string Name;
+  StringRef Name;
   ExprAST* AssignExpr;
   ExprAST* OffsetExpr;
+  VarRef Ref;
 
 public:
-  AssignmentAST(const std::string Name, ExprAST* AssignExpr);
-  AssignmentAST(const std::string Name, ExprAST* OffsetExpr, ExprAST* AssignExpr);
+  const char *className() const override { return "AssignmentAST"; };
+  AssignmentAST(StringRef Name, ExprAST* AssignExpr);
+  AssignmentAST(StringRef Name, ExprAST* OffsetExpr, ExprAST* AssignExpr);
+  bool resolve(driver& drv) override;
+  AssignmentAST *fold(driver& drv) override;
+  void hash(driver& drv, MD5& H) override;
   Value *codegen(driver& drv) override;
-  const std::string& getName() const;
+  StringRef getName() const;
 };
 
 //IfStmtAST classe per gli If/Else
@@ -253,38 +679,70 @@ private:
   StmtAST* TrueStmt;
   StmtAST* ElseStmt;
 public: 
+  const char *className() const override { return "IfStmtAST"; };
   IfStmtAST(ExprAST* CondExpr, StmtAST* TrueStmt, StmtAST* ElseStmt = nullptr);
+  bool resolve(driver& drv) override;
+  StmtAST *fold(driver& drv) override;
+  void hash(driver& drv, MD5& H) override;
+  bool markTail(StringRef Caller) override;
   Value *codegen(driver& drv) override;
 };
 
+//LoopStmtAST classe base dei cicli, con i suggerimenti di ottimizzazione
+class LoopStmtAST : public StmtAST {
+  protected:
+    LoopHints Hints;
+    MDNode *loopID(driver& drv);
+    void hashHints(MD5& H);
+    // Contatore delle iterazioni (--instrument=loops): azzerato prima del
+    // ciclo, incrementato al salto all'indietro, comunicato al runtime all'uscita
+    AllocaInst *startTrips(driver& drv);
+    void countTrip(driver& drv, AllocaInst *Trips);
+    void endTrips(driver& drv, AllocaInst *Trips, driver::ProfileKind Kind);
+  public:
+    bool addHint(StringRef Name, int Arg);
+};
+
 //ForStmtAST classe per il For. 
-class ForStmtAST : public StmtAST {
+class ForStmtAST : public LoopStmtAST {
   private:
     VarOperation* InitExp;
     ExprAST* CondExpr;
     AssignmentAST* AssignExpr;
     StmtAST* BodyStmt;
   public: 
+    const char *className() const override { return "ForStmtAST"; };
     ForStmtAST(VarOperation* InitExp, ExprAST* CondExpr, AssignmentAST* AssignExpr, StmtAST* BodyStmt);
+    bool resolve(driver& drv) override;
+  StmtAST *fold(driver& drv) override;
+  void hash(driver& drv, MD5& H) override;
     Value *codegen(driver& drv) override;
 };
 
 //WhileStmt classe per il While. 
-class WhileStmtAST : public StmtAST {
+class WhileStmtAST : public LoopStmtAST {
   private:
     ExprAST* CondExpr;
     StmtAST* BodyStmt;
   public: 
+    const char *className() const override { return "WhileStmtAST"; };
     WhileStmtAST(ExprAST* CondExpr, StmtAST* BodyStmt);
+    bool resolve(driver& drv) override;
+  StmtAST *fold(driver& drv) override;
+  void hash(driver& drv, MD5& H) override;
     Value *codegen(driver& drv) override;
 };
 
 //Classe che servirà per il FOR poichè come attributo ha una variant che può diventare o un Binding o un Assignment. 
-class VarOperation : RootAST {
+class VarOperation : public RootAST {
   private:
     varOp operation;
   public: 
+    const char *className() const override { return "VarOperation"; };
     VarOperation(varOp operation);
+    bool resolve(driver& drv) override;
+  VarOperation *fold(driver& drv) override;
+  void hash(driver& drv, MD5& H) override;
     varOp getOp();
 };
 #endif // ! DRIVER_HH
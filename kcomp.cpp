@@ -1,24 +1,236 @@
+#include <cerrno>
+#include <climits>
 #include <iostream>
 #include "driver.hpp"
+#include "llvm/Support/ThreadPool.h"
 
-extern LLVMContext *context;
-extern Module *module;
-extern IRBuilder<> *builder;
+// Restituisce il valore di un'opzione nella forma "--nome=valore"
+// (nullptr se argv[i] non è l'opzione cercata)
+static const char *optval(const char *arg, const std::string &name) {
+  return std::string(arg).rfind(name + "=", 0) == 0 ? arg + name.size() + 1 : nullptr;
+}
+
+// Compilazione di un file con un driver dedicato (e dunque con un proprio
+// contesto LLVM): la funzione può essere eseguita in parallelo su file diversi
+// In stats restituisce i tempi e i contatori della compilazione
+static int compile(const options &opts, const std::string &f, std::string &listing,
+                   statistics &stats) {
+  driver drv(opts);
+  int res = drv.parse(f) || drv.codegen(); // Parsing, visita AST, ottimizzazione ed emissione
+  listing = std::move(drv.listing);
+  stats = std::move(drv.Stats);
+  return res;
+}
 
 int main (int argc, char *argv[]) {
   int res = 0;
-  driver drv;
+  options opts;
+  std::vector<std::string> files;
   int i = 1;
+  const char *val;
   while (i<argc) {
     if (argv[i] == std::string ("-p"))
-      drv.trace_parsing = true; // Abilita tracce debug nel parser
+      opts.trace_parsing = true; // Abilita tracce debug nel parser
     else if (argv[i] == std::string ("-s"))
-      drv.trace_scanning = true;// Abilita tracce debug nello scanner
-    else  if (!drv.parse(argv[i])) { // Parsing e creazione dell'AST
-      drv.codegen();                 // Visita AST e generazione dell'IR (su stderr)
-    } else
-      res = 1;
+      opts.trace_scanning = true;// Abilita tracce debug nello scanner
+    else if (argv[i][0] == '-' && argv[i][1] == 'O') {
+      std::string level(argv[i] + 2); // Livello di ottimizzazione (-O0 ... -O3)
+      if (level.size() != 1 || level[0] < '0' || level[0] > '3') {
+        std::cerr << "livello di ottimizzazione non valido: " << argv[i] << std::endl;
+        return 1;
+      }
+      opts.opt_level = level[0] - '0';
+    } else if (argv[i] == std::string ("--per-function"))
+      opts.opt_per_function = true; // Ottimizza le funzioni una alla volta
+    else if (argv[i] == std::string ("--print-pipeline"))
+      opts.print_pipeline = true; // Stampa la pipeline di ottimizzazione
+    else if ((val = optval(argv[i], "--emit")))
+      opts.emit_kind = val;       // Formato di uscita: obj, asm, bc, ll
+    else if (argv[i] == std::string ("-o") && i+1 < argc)
+      opts.output = argv[++i];    // File di uscita
+    else if ((val = optval(argv[i], "-mcpu")))
+      opts.mcpu = val;            // CPU target (native = quella dell'host)
+    else if ((val = optval(argv[i], "-relocation-model")))
+      opts.reloc_model = val;
+    else if ((val = optval(argv[i], "-code-model")))
+      opts.code_model = val;
+    else if ((val = optval(argv[i], "-Rpass")))
+      opts.rpass = val;           // Remark delle trasformazioni effettuate
+    else if ((val = optval(argv[i], "-Rpass-missed")))
+      opts.rpass_missed = val;    // Remark delle trasformazioni non riuscite
+    else if ((val = optval(argv[i], "-Rpass-analysis")))
+      opts.rpass_analysis = val;  // Remark con le motivazioni dei passi
+    else if (argv[i] == std::string ("-ffast-math"))
+      opts.fast_math.setFast();   // Tutte le ottimizzazioni fast-math
+    else if (argv[i] == std::string ("-fno-fast-math"))
+      opts.fast_math.clear();
+    else if (argv[i] == std::string ("-fno-honor-nans"))
+      opts.fast_math.setNoNaNs(); // Si assume che non compaiano NaN
+    else if (argv[i] == std::string ("-fno-honor-infinities"))
+      opts.fast_math.setNoInfs(); // Si assume che non compaiano infiniti
+    else if (argv[i] == std::string ("-fno-signed-zeros"))
+      opts.fast_math.setNoSignedZeros();
+    else if (argv[i] == std::string ("-fassociative-math"))
+      opts.fast_math.setAllowReassoc(); // Riassociazione (riduzioni vettoriali)
+    else if (argv[i] == std::string ("-freciprocal-math"))
+      opts.fast_math.setAllowReciprocal(); // x/c diventa x*(1/c)
+    else if ((val = optval(argv[i], "-ffp-contract"))) {
+      // fast: moltiplicazioni e somme possono essere fuse in FMA
+      if (val != std::string ("fast") && val != std::string ("on") && val != std::string ("off")) {
+        std::cerr << "valore non valido per -ffp-contract: " << val << std::endl;
+        return 1;
+      }
+      opts.fast_math.setAllowContract(val == std::string ("fast"));
+    } else if (argv[i] == std::string ("-g"))
+      opts.debug_info = true;     // Informazioni di debug DWARF
+    else if (argv[i] == std::string ("--instrument"))
+      opts.instrument = true;     // Profilo delle funzioni (runtime kruntime.cpp)
+    else if (argv[i] == std::string ("--instrument=loops"))
+      opts.instrument = opts.instrument_loops = true; // Anche iterazioni dei cicli
+    else if (argv[i] == std::string ("-fprofile-generate"))
+      opts.profile_generate = true; // Contatori per la profile-guided optimization
+    else if ((val = optval(argv[i], "-fprofile-generate"))) {
+      // Directory del profilo grezzo: un file per ogni eseguibile, come in clang
+      opts.profile_generate = true;
+      opts.profile_raw = std::string(val) + "/default_%m.profraw";
+    } else if ((val = optval(argv[i], "-fprofile-use")))
+      opts.profile_use = val;     // Profilo indicizzato (llvm-profdata merge)
+    else if (argv[i] == std::string ("--batch"))
+      opts.batch = true;          // f_batch per ogni funzione con soli parametri double
+    else if (argv[i] == std::string ("--batch-threads"))
+      opts.batch_threads = true;  // Anche f_batch_mt (runtime kruntime.cpp)
+    else if ((val = optval(argv[i], "--header")))
+      opts.header = val;          // Header C delle funzioni del modulo
+    else if (argv[i] == std::string ("-fno-builtin"))
+      opts.builtins = false;      // Le funzioni extern restano chiamate opache
+    else if (std::string(argv[i]).rfind("-fno-builtin-", 0) == 0)
+      opts.no_builtins.push_back(argv[i] + 13);
+    else if (argv[i] == std::string ("--jit"))
+      opts.jit = true;            // Esecuzione diretta con ORC LLJIT
+    else if ((val = optval(argv[i], "--entry")))
+      opts.jit_entry = val;       // Funzione da eseguire
+    else if ((val = optval(argv[i], "--arg")))
+      opts.jit_args.push_back(strtod(val, nullptr)); // Argomento della funzione
+    else if (argv[i][0] == '-' && argv[i][1] == 'l') {
+      // Libreria condivisa per gli extern: -lfoo (libfoo.so) oppure -l percorso/lib.so
+      std::string lib = argv[i][2] ? argv[i] + 2 : (i+1 < argc ? argv[++i] : "");
+      if (lib.find('/') == std::string::npos && lib.find(".so") == std::string::npos)
+        lib = "lib" + lib + ".so";
+      opts.jit_libs.push_back(lib);
+    } else if (argv[i][0] == '-' && argv[i][1] == 'j') {
+      // Numero di file compilati in parallelo: -jN oppure -j N
+      const char *n = argv[i][2] ? argv[i] + 2 : (i+1 < argc ? argv[++i] : "");
+      char *end;
+      errno = 0;
+      long jobs = strtol(n, &end, 10);
+      if (end == n || *end || errno || jobs < 1 || jobs > UINT_MAX) {
+        std::cerr << "numero di job non valido: " << n << std::endl;
+        return 1;
+      }
+      opts.jobs = jobs;
+    } else if ((val = optval(argv[i], "--cache-dir")))
+      opts.cache_dir = val;       // Cache persistente delle funzioni compilate
+    else if (argv[i] == std::string ("--cache-stats"))
+      opts.cache_stats = true;    // Stampa successi e fallimenti della cache
+    else if (argv[i] == std::string ("--time-report"))
+      opts.time_report = true;    // Tabella dei tempi delle fasi e contatori
+    else if (argv[i] == std::string ("--stats=json"))
+      opts.stats_file = "kcomp-stats.json";
+    else if ((val = optval(argv[i], "--stats=json")))
+      opts.stats_file = val;      // Tempi e contatori in formato JSON
+    else
+      files.push_back(argv[i]);
     i++;
   };
+  if (opts.jit && opts.jit_entry.empty()) {
+    std::cerr << "--jit richiede --entry=<funzione>" << std::endl;
+    return 1;
+  }
+  if (opts.jit && opts.jobs > 1) {
+    std::cerr << "--jit non è compatibile con -j" << std::endl;
+    return 1;
+  }
+  for (const std::string *re : {&opts.rpass, &opts.rpass_missed, &opts.rpass_analysis}) {
+    std::string err;
+    if (!re->empty() && !Regex(*re).isValid(err)) {
+      std::cerr << "espressione regolare non valida: " << *re << ": " << err << std::endl;
+      return 1;
+    }
+  }
+  if (opts.profile_generate && !opts.profile_use.empty()) {
+    std::cerr << "-fprofile-generate non è compatibile con -fprofile-use" << std::endl;
+    return 1;
+  }
+  // Strumentazione e lettura del profilo fanno parte della pipeline del modulo
+  // Nella modalità a modulo intero le funzioni sono ottimizzate insieme, dopo
+  // la generazione: la cache conterrebbe solo IR non ottimizzato e un
+  // successo eviterebbe soltanto il front-end
+  if (!opts.cache_dir.empty() && opts.opt_level > 0 && !opts.opt_per_function) {
+    std::cerr << "--cache-dir con -O1, -O2 o -O3 richiede --per-function" << std::endl;
+    return 1;
+  }
+  if ((opts.profile_generate || !opts.profile_use.empty()) && opts.opt_per_function) {
+    std::cerr << "i profili non sono compatibili con --per-function" << std::endl;
+    return 1;
+  }
+  if (opts.profile_generate && opts.jit) {
+    std::cerr << "-fprofile-generate non è compatibile con --jit" << std::endl;
+    return 1;
+  }
+  if (!opts.profile_use.empty() && !sys::fs::exists(opts.profile_use)) {
+    std::cerr << "profilo " << opts.profile_use << " non trovato" << std::endl;
+    return 1;
+  }
+  if (!opts.output.empty() && files.size() > 1) {
+    std::cerr << "-o richiede un solo file sorgente" << std::endl;
+    return 1;
+  }
+  if (!opts.header.empty() && files.size() > 1) {
+    std::cerr << "--header richiede un solo file sorgente" << std::endl;
+    return 1;
+  }
+
+  // Inizializzazione del target nativo (necessaria per emettere oggetti e
+  // assembly e per il JIT)
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+  InitializeNativeTargetAsmParser();
+
+  std::vector<int> results(files.size());
+  std::vector<std::string> listings(files.size());
+  std::vector<statistics> stats(files.size());
+  if (opts.jobs == 1) {
+    for (size_t k = 0; k < files.size(); k++)
+      results[k] = compile(opts, files[k], listings[k], stats[k]);
+  } else {
+    ThreadPool pool(hardware_concurrency(opts.jobs));
+    for (size_t k = 0; k < files.size(); k++)
+      pool.async([&, k] { results[k] = compile(opts, files[k], listings[k], stats[k]); });
+    pool.wait();
+  }
+  // L'IR eventualmente raccolto dai driver viene emesso nell'ordine dei file
+  // Le statistiche dei file sono sommate (con -j i tempi sono quindi tempi
+  // di CPU complessivi dei thread)
+  statistics total;
+  for (size_t k = 0; k < files.size(); k++) {
+    errs() << listings[k];
+    if (results[k])
+      res = 1;
+    total.merge(stats[k]);
+  }
+  if (opts.cache_stats)
+    std::cerr << "cache " << opts.cache_dir << ": " << total.CacheHits << " hit, "
+              << total.CacheMisses << " miss" << std::endl;
+  if (opts.time_report)
+    total.print(errs());
+  if (!opts.stats_file.empty()) {
+    std::error_code EC;
+    raw_fd_ostream OS(opts.stats_file, EC, sys::fs::OF_Text);
+    if (EC) {
+      std::cerr << "impossibile aprire " << opts.stats_file << ": " << EC.message() << std::endl;
+      return 1;
+    }
+    total.printJSON(OS);
+  }
   return res;
 }
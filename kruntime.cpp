@@ -0,0 +1,231 @@
+// Runtime dei programmi compilati con kcomp: profilo (--instrument) ed
+// esecuzione parallela delle funzioni batch (--batch-threads).
+//
+// Il codice generato chiama __kcomp_prof_enter e __kcomp_prof_exit
+// all'ingresso e all'uscita di ogni funzione e, con --instrument=loops,
+// __kcomp_prof_loop all'uscita di ogni ciclo, passando il descrittore
+// costante del sito (riga, tipo e nome della funzione). Ogni thread accumula
+// i dati in un proprio buffer, senza sincronizzazione; alla terminazione del
+// thread il buffer viene sommato a quello globale e alla terminazione del
+// programma si stampa il resoconto su stderr (o nel file indicato dalla
+// variabile d'ambiente KCOMP_PROF): funzioni ordinate per tempo proprio e
+// cicli ordinati per numero di iterazioni. Uso:
+//
+// > kcomp --instrument=loops -O2 --emit=obj prog.k
+// > g++ -O2 -o prog main.cpp prog.o kruntime.cpp -lpthread
+//
+// oppure, in modalità JIT, con il runtime compilato come libreria condivisa
+//
+// > g++ -O2 -shared -fPIC -o libkruntime.so kruntime.cpp
+// > kcomp --instrument --jit --entry=main -l ./libkruntime.so prog.k
+//
+// Il tempo è misurato in cicli del contatore del processore (rdtsc su x86-64,
+// altrimenti in nanosecondi) e convertito in millisecondi nel resoconto. Il
+// tempo totale di una funzione ricorsiva è contato una sola volta, per la
+// chiamata più esterna; il tempo proprio esclude quello delle funzioni
+// chiamate (e dei loro cicli di profilo)
+//
+// Le funzioni f_batch_mt generate con --batch-threads dividono i loro
+// elementi fra più thread con __kcomp_parallel_for (in fondo al file)
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Descrittore di un sito, generato da driver::profileSite
+struct kcomp_site {
+  uint32_t line;
+  uint32_t kind;   // 0 funzione, 1 for, 2 while
+  char name[1];    // Nome della funzione, terminato da zero
+};
+
+static const char *kinds[] = {"funzione", "for", "while"};
+
+static inline uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+struct counters {
+  uint64_t calls = 0;    // Chiamate (funzioni) o esecuzioni (cicli)
+  uint64_t self = 0;     // Tempo proprio
+  uint64_t total = 0;    // Tempo comprese le funzioni chiamate
+  uint64_t trips = 0;    // Iterazioni complessive dei cicli
+  uint64_t maxtrips = 0; // Iterazioni della esecuzione più lunga
+  unsigned depth = 0;    // Attivazioni in corso (ricorsione)
+
+  void merge(const counters &C) {
+    calls += C.calls;
+    self += C.self;
+    total += C.total;
+    trips += C.trips;
+    maxtrips = std::max(maxtrips, C.maxtrips);
+  }
+};
+
+typedef std::unordered_map<const kcomp_site *, counters> table;
+
+// Attivazione di una funzione sulla pila del thread
+struct frame {
+  counters *C;
+  uint64_t start;
+  uint64_t children; // Tempo delle funzioni chiamate
+};
+
+struct buffer;
+
+// Dati dei thread terminati e buffer dei thread ancora attivi. La
+// distruzione, alla terminazione del programma, stampa il resoconto
+static struct registry {
+  std::mutex lock;
+  table merged;
+  std::vector<buffer *> live;
+  unsigned threads = 0;
+  uint64_t tick0 = ticks();
+  std::chrono::steady_clock::time_point time0 = std::chrono::steady_clock::now();
+  ~registry();
+} reg;
+
+struct buffer {
+  table data;
+  std::vector<frame> stack;
+
+  buffer() {
+    std::lock_guard<std::mutex> G(reg.lock);
+    reg.live.push_back(this);
+    reg.threads++;
+  }
+  ~buffer() {
+    std::lock_guard<std::mutex> G(reg.lock);
+    flush();
+    reg.live.erase(std::find(reg.live.begin(), reg.live.end(), this));
+  }
+  // Da chiamare con reg.lock acquisito
+  void flush() {
+    for (auto &E : data)
+      reg.merged[E.first].merge(E.second);
+    data.clear();
+  }
+};
+
+static thread_local buffer local;
+
+extern "C" void __kcomp_prof_enter(const kcomp_site *site) {
+  counters &C = local.data[site];
+  C.calls++;
+  C.depth++;
+  local.stack.push_back({&C, ticks(), 0});
+}
+
+// Il sito è quello del frame in cima alla pila, aperto da __kcomp_prof_enter
+extern "C" void __kcomp_prof_exit(const kcomp_site *) {
+  uint64_t now = ticks();
+  frame F = local.stack.back();
+  local.stack.pop_back();
+  uint64_t elapsed = now - F.start;
+  F.C->self += elapsed - F.children;
+  if (--F.C->depth == 0)
+    F.C->total += elapsed;
+  if (!local.stack.empty())
+    local.stack.back().children += elapsed;
+}
+
+extern "C" void __kcomp_prof_loop(const kcomp_site *site, int64_t trips) {
+  counters &C = local.data[site];
+  C.calls++;
+  C.trips += trips;
+  C.maxtrips = std::max<uint64_t>(C.maxtrips, trips);
+}
+
+registry::~registry() {
+  // I buffer dei thread ancora in esecuzione sono letti senza fermarli: i
+  // loro dati più recenti possono mancare
+  for (buffer *B : live)
+    B->flush();
+  if (merged.empty())
+    return;
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - time0).count();
+  uint64_t elapsed = std::max<uint64_t>(1, ticks() - tick0);
+  double perTick = ms / elapsed;
+
+  std::vector<std::pair<const kcomp_site *, counters>> funcs, loops;
+  uint64_t selfSum = 0;
+  for (auto &E : merged)
+    if (E.first->kind == 0) {
+      funcs.push_back(E);
+      selfSum += E.second.self;
+    } else
+      loops.push_back(E);
+  std::sort(funcs.begin(), funcs.end(), [](auto &A, auto &B) { return A.second.self > B.second.self; });
+  std::sort(loops.begin(), loops.end(), [](auto &A, auto &B) { return A.second.trips > B.second.trips; });
+
+  const char *path = getenv("KCOMP_PROF");
+  FILE *out = path ? fopen(path, "w") : nullptr;
+  if (!out)
+    out = stderr;
+  fprintf(out, "kcomp profile: %zu funzioni, %zu cicli, %u thread, %.3f ms\n",
+          funcs.size(), loops.size(), threads, ms);
+  if (!funcs.empty()) {
+    fprintf(out, "%12s %7s %12s %14s %12s  %s\n", "self ms", "self %", "total ms", "calls", "ns/call", "funzione");
+    for (auto &[S, C] : funcs)
+      fprintf(out, "%12.3f %6.1f%% %12.3f %14llu %12.1f  %s:%u\n", C.self * perTick,
+              selfSum ? 100.0 * C.self / selfSum : 0.0, C.total * perTick, (unsigned long long)C.calls,
+              C.calls ? C.total * perTick * 1e6 / C.calls : 0.0, S->name, S->line);
+  }
+  if (!loops.empty()) {
+    fprintf(out, "%14s %16s %12s %12s  %s\n", "esecuzioni", "iterazioni", "media", "massimo", "ciclo");
+    for (auto &[S, C] : loops)
+      fprintf(out, "%14llu %16llu %12.1f %12llu  %s %s:%u\n", (unsigned long long)C.calls,
+              (unsigned long long)C.trips, C.calls ? (double)C.trips / C.calls : 0.0,
+              (unsigned long long)C.maxtrips, kinds[S->kind < 3 ? S->kind : 0], S->name, S->line);
+  }
+  if (out != stderr)
+    fclose(out);
+}
+
+// Numero minimo di elementi per thread: per blocchi più piccoli la creazione
+// dei thread costa più di quanto si guadagni
+static const int64_t MinBlock = 1024;
+
+// Chiama body(ctx, inizio, fine) su blocchi contigui che coprono [0, n), uno
+// per thread; il primo blocco è eseguito dal thread chiamante. threads <= 0
+// indica un thread per core. Se un thread non può essere creato, il suo
+// blocco è eseguito dal chiamante
+extern "C" void __kcomp_parallel_for(void (*body)(void *, int64_t, int64_t), void *ctx, int64_t n,
+                                     int64_t threads) {
+  if (threads <= 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = std::min(threads, n / MinBlock);
+  if (threads <= 1) {
+    body(ctx, 0, n);
+    return;
+  }
+  int64_t chunk = (n + threads - 1) / threads;
+  std::vector<std::thread> pool;
+  for (int64_t t = 1; t < threads; t++) {
+    int64_t begin = t * chunk, end = std::min(n, begin + chunk);
+    if (begin >= end)
+      break;
+    try {
+      pool.emplace_back(body, ctx, begin, end);
+    } catch (const std::system_error &) {
+      body(ctx, begin, end);
+    }
+  }
+  body(ctx, 0, chunk);
+  for (std::thread &T : pool)
+    T.join();
+}
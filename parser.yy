@@ -8,16 +8,20 @@
 %define parse.assert
 
 %code requires {
+  # include <climits>
   # include <string>
+  # include <utility>
+  # include <vector>
+  # include "llvm/ADT/StringRef.h"
   #include <exception>
   class driver;
+  struct ParamDecl;
   class RootAST;
   class ExprAST;
   class NumberExprAST;
   class VariableExprAST;
   class CallExprAST;
   class FunctionAST;
-  class SeqAST;
   class PrototypeAST;
   class BlockAST;
   class BindingAST;
@@ -29,6 +33,7 @@
   class IfStmtAST;
   class ForStmtAST;
   class WhileStmtAST;
+  class LoopStmtAST;
   class VarOperation;
   class ArrayExprAST;
 }
@@ -43,6 +48,29 @@
 
 %code {
 # include "driver.hpp"
+
+// Il parser calcola la posizione di ogni produzione prima di eseguirne
+// l'azione: la posizione del primo token diventa quella dei nodi AST creati
+// dall'azione (RootAST::NextLoc), usata per le informazioni di debug (-g)
+# define YYLLOC_DEFAULT(Current, Rhs, N)                                  \
+  do {                                                                    \
+    if (N) {                                                              \
+      (Current).begin = YYRHSLOC (Rhs, 1).begin;                          \
+      (Current).end = YYRHSLOC (Rhs, N).end;                              \
+    } else                                                                \
+      (Current).begin = (Current).end = YYRHSLOC (Rhs, 0).end;            \
+    RootAST::NextLoc = {unsigned ((Current).begin.line),                  \
+                        unsigned ((Current).begin.column)};               \
+  } while (false)
+
+// L'argomento di un suggerimento per i cicli è un intero in [1, INT_MAX]
+static int
+hint_arg (const yy::parser::location_type& l, double n)
+{
+  if (!(n >= 1 && n <= INT_MAX) || n != (int) n)
+    throw yy::parser::syntax_error (l, "invalid loop hint argument");
+  return (int) n;
+}
 }
 
 %define api.token.prefix {TOK_}
@@ -66,6 +94,7 @@
   RBRACE     "}"
   LSQBR      "["
   RSQBR      "]"
+  HASH       "#"
   EXTERN     "extern"
   DEF        "def"
   VAR        "var"
@@ -79,7 +108,7 @@
   NOT        "not"
 ;
 
-%token <std::string> IDENTIFIER "id"
+%token <llvm::StringRef> IDENTIFIER "id"
 %token <double> NUMBER "number"
 %type <ExprAST*> exp
 %type <ExprAST*> initexp
@@ -89,12 +118,13 @@
 %type <ExprAST*> relexp
 %type <std::vector<ExprAST*>> optexp
 %type <std::vector<ExprAST*>> explist
-%type <RootAST*> program
 %type <RootAST*> top
 %type <FunctionAST*> definition
 %type <PrototypeAST*> external
 %type <PrototypeAST*> proto
-%type <std::vector<std::string>> idseq
+%type <std::vector<ParamDecl>> idseq
+%type <unsigned> vectype
+%type <std::vector<llvm::StringRef>> qualifiers
 %type <BlockAST*> block
 %type <std::vector<BindingAST*>> vardefs
 %type <BindingAST*> binding
@@ -105,17 +135,21 @@
 %type <IfStmtAST*> ifstmt
 %type <ForStmtAST*> forstmt
 %type <WhileStmtAST*> whilestmt
+%type <LoopStmtAST*> loopstmt
+%type <std::pair<llvm::StringRef,int>> hint
 %type <VarOperation*> init
 
 %%
 %start startsymb;
 
 startsymb:
-program                 { drv.root = $1; };
+program;
 
+// La ricorsione a sinistra mantiene costante la profondità dello stack del
+// parser e permette di generare il codice di ogni definizione appena riconosciuta
 program:
-  %empty                { $$ = new SeqAST(nullptr,nullptr); }
-|  top ";" program      { $$ = new SeqAST($1,$3); };
+  %empty
+| program top ";"       { if ($2) drv.codegen($2); };
 
 top:
 %empty                  { $$ = nullptr; }
@@ -123,23 +157,51 @@ top:
 | external              { $$ = $1; }
 | globalvar             { $$ = $1; };
 
+// I qualificatori che precedono "def" non sono parole riservate ma identificatori,
+// controllati dalla FunctionAST (ad esempio fast def f(x) ...)
 definition:
-  "def" proto block     { $$ = new FunctionAST($2,$3); $2->noemit(); }; //!
+  qualifiers "def" proto block  { $$ = new (drv) FunctionAST($3,$4);
+                                  for (llvm::StringRef q : $1)
+                                    if (!$$->addQualifier(q))
+                                      throw yy::parser::syntax_error (@2, "invalid qualifier: " + q.str()); };
+
+qualifiers:
+  %empty                { std::vector<llvm::StringRef> quals;
+                          $$ = quals; }
+| qualifiers "id"       { $1.push_back($2); $$ = std::move($1); };
 
 external:
   "extern" proto        { $$ = $2; };
 
+// Il risultato è double oppure, se indicato, un vettore: def f(x: vec4): vec4
 proto:
-  "id" "(" idseq ")"    { $$ = new PrototypeAST($1,$3);  };
+  "id" "(" idseq ")"    { $$ = new (drv) PrototypeAST($1,drv.copy($3));  }
+| "id" "(" idseq ")" ":" vectype  { $$ = new (drv) PrototypeAST($1,drv.copy($3),$6); };
 
 globalvar:
-  "global" "id"                   { $$ = new GlobalVarAST($2); }
-| "global" "id" "[" "number" "]"  { $$ = new GlobalVarAST($2, $4); };
+  "global" "id"                   { $$ = new (drv) GlobalVarAST($2); }
+| "global" "id" "[" "number" "]"  { $$ = new (drv) GlobalVarAST($2, $4); };
 
+// Un parametro array (double* nel codice generato) può indicare il numero
+// dei propri elementi, costante oppure contenuto in un altro parametro.
+// Un parametro vettoriale ne indica il tipo (x: vec4)
 idseq:
-  %empty                { std::vector<std::string> args;
+  %empty                { std::vector<ParamDecl> args;
                          $$ = args; }
-| "id" idseq            { $2.insert($2.begin(),$1); $$ = $2; };
+| idseq "id"            { $1.push_back(ParamDecl{$2}); $$ = std::move($1); }
+| idseq "id" "[" "]"    { $1.push_back(ParamDecl{$2, true}); $$ = std::move($1); }
+| idseq "id" "[" "number" "]"  { if (!($4 >= 1 && $4 <= UINT_MAX) || $4 != (unsigned)$4)
+                                   throw yy::parser::syntax_error (@4, "invalid array size");
+                                 $1.push_back(ParamDecl{$2, true, (unsigned)$4}); $$ = std::move($1); }
+| idseq "id" "[" "id" "]"      { $1.push_back(ParamDecl{$2, true, 0, $4}); $$ = std::move($1); }
+| idseq "id" ":" vectype       { $1.push_back(ParamDecl{$2, false, 0, {}, $4}); $$ = std::move($1); };
+
+// I nomi dei tipi vettoriali non sono parole riservate ma identificatori
+// (vec4 resta anche il nome dell'operazione che costruisce un vec4)
+vectype:
+  "id"                  { $$ = $1 == "vec2" ? 2 : $1 == "vec4" ? 4 : $1 == "vec8" ? 8 : 0;
+                          if (!$$)
+                            throw yy::parser::syntax_error (@1, "invalid type: " + $1.str()); };
 
 %left ":";
 %left "<" ">" "==";
@@ -150,50 +212,49 @@ stmts:
   stmt                  { std::vector<StmtAST*> statements;
                           statements.push_back($1);
                           $$ = statements; }
-| stmt ";" stmts        { $3.insert($3.begin(), $1);
-                          $$ = $3; };
+| stmts ";" stmt        { $1.push_back($3);
+                          $$ = std::move($1); };
 
 stmt:
   assignment            { $$ = $1; }
 | block                 { $$ = $1; }
 | ifstmt                { $$ = $1; }
-| forstmt               { $$ = $1; }
-| whilestmt             { $$ = $1; }
+| loopstmt              { $$ = $1; }
 | exp                   { $$ = $1; };
 
 assignment:
- "id" "=" exp               { $$ = new AssignmentAST($1, $3); } 
-| "+" "+" "id"              { $$ = new AssignmentAST($3,new BinaryExprAST('+',new VariableExprAST($3),new NumberExprAST(1.0)));}   
-//| "id" "+" "+"            { $$ = new AssignmentAST($1,new BinaryExprAST('+',new VariableExprAST($1),new NumberExprAST(1.0)));}
-| "-" "-" "id"              { $$ = new AssignmentAST($3,new BinaryExprAST('-',new VariableExprAST($3),new NumberExprAST(1.0)));}
-//| "id" "-" "-"            { $$ = new AssignmentAST($1,new BinaryExprAST('-',new VariableExprAST($1),new NumberExprAST(1.0)));};          
-| "id" "[" exp "]" "=" exp  { $$ = new AssignmentAST($1,$3,$6); }; //NEW
+ "id" "=" exp               { $$ = new (drv) AssignmentAST($1, $3); } 
+| "+" "+" "id"              { $$ = new (drv) AssignmentAST($3,new (drv) BinaryExprAST('+',new (drv) VariableExprAST($3),new (drv) NumberExprAST(1.0)));}   
+//| "id" "+" "+"            { $$ = new (drv) AssignmentAST($1,new (drv) BinaryExprAST('+',new (drv) VariableExprAST($1),new (drv) NumberExprAST(1.0)));}
+| "-" "-" "id"              { $$ = new (drv) AssignmentAST($3,new (drv) BinaryExprAST('-',new (drv) VariableExprAST($3),new (drv) NumberExprAST(1.0)));}
+//| "id" "-" "-"            { $$ = new (drv) AssignmentAST($1,new (drv) BinaryExprAST('-',new (drv) VariableExprAST($1),new (drv) NumberExprAST(1.0)));};          
+| "id" "[" exp "]" "=" exp  { $$ = new (drv) AssignmentAST($1,$3,$6); }; //NEW
 
 
 block:
-  "{" stmts "}"             { $$ = new BlockAST($2); }
-| "{" vardefs ";" stmts "}" { $$ = new BlockAST($2,$4); };
+  "{" stmts "}"             { $$ = new (drv) BlockAST(drv.copy($2)); }
+| "{" vardefs ";" stmts "}" { $$ = new (drv) BlockAST(drv.copy($2),drv.copy($4)); };
 
 vardefs:
   binding               { std::vector<BindingAST*> definitions;
                           definitions.push_back($1);
                           $$ = definitions; }
-| vardefs ";" binding   { $1.push_back($3); $$ = $1; };
+| vardefs ";" binding   { $1.push_back($3); $$ = std::move($1); };
 
 binding:
-  "var" "id" initexp                                  { $$ = new VarBindingAST($2,$3); }
-| "var" "id" "[" "number" "]"                         { $$ = new ArrayBindingAST($2,$4); } //NEW
-| "var" "id" "[" "number" "]" "=" "{" explist "}"     { $$ = new ArrayBindingAST($2,$4,$8); }; //NEW
+  "var" "id" initexp                                  { $$ = new (drv) VarBindingAST($2,$3); }
+| "var" "id" "[" exp "]"                         { $$ = new (drv) ArrayBindingAST($2,$4); } //NEW
+| "var" "id" "[" exp "]" "=" "{" explist "}"     { $$ = new (drv) ArrayBindingAST($2,$4,drv.copy($8)); }; //NEW
                     
 exp:
-  exp "+" exp           { $$ = new BinaryExprAST('+',$1,$3); }
-| exp "-" exp           { $$ = new BinaryExprAST('-',$1,$3); }
-| exp "*" exp           { $$ = new BinaryExprAST('*',$1,$3); }
-| exp "/" exp           { $$ = new BinaryExprAST('/',$1,$3); }
+  exp "+" exp           { $$ = new (drv) BinaryExprAST('+',$1,$3); }
+| exp "-" exp           { $$ = new (drv) BinaryExprAST('-',$1,$3); }
+| exp "*" exp           { $$ = new (drv) BinaryExprAST('*',$1,$3); }
+| exp "/" exp           { $$ = new (drv) BinaryExprAST('/',$1,$3); }
 | idexp                 { $$ = $1; }
 | "(" exp ")"           { $$ = $2; }
-| "-" exp               { $$ = new BinaryExprAST('*',$2, new NumberExprAST(-1.0)); }
-| "number"              { $$ = new NumberExprAST($1); }
+| "-" exp               { $$ = new (drv) BinaryExprAST('*',$2, new (drv) NumberExprAST(-1.0)); }
+| "number"              { $$ = new (drv) NumberExprAST($1); }
 | expif                 { $$ = $1; };
 
 initexp: 
@@ -201,24 +262,32 @@ initexp:
 | "=" exp               { $$ = $2; };
 
 expif:
-  condexp "?" exp ":" exp { $$ = new IfExprAST($1,$3,$5); };
+  condexp "?" exp ":" exp { $$ = new (drv) IfExprAST($1,$3,$5); };
 
 condexp:
   relexp                  { $$ = $1; }
-| relexp "and" condexp    { $$ = new BinaryExprAST('a',$1,$3); }
-| relexp "or" condexp     { $$ = new BinaryExprAST('o',$1,$3); }
-| "not" condexp           { $$ = new BinaryExprAST('n',$2); }
+| relexp "and" condexp    { $$ = new (drv) BinaryExprAST('a',$1,$3); }
+| relexp "or" condexp     { $$ = new (drv) BinaryExprAST('o',$1,$3); }
+| "not" condexp           { $$ = new (drv) BinaryExprAST('n',$2); }
 | "(" condexp ")"         { $$ = $2; };
 
 relexp:
-  exp "<" exp           { $$ = new BinaryExprAST('<',$1,$3); }
-| exp ">" exp           { $$ = new BinaryExprAST('>',$1,$3); }
-| exp "==" exp          { $$ = new BinaryExprAST('=',$1,$3); };
+  exp "<" exp           { $$ = new (drv) BinaryExprAST('<',$1,$3); }
+| exp ">" exp           { $$ = new (drv) BinaryExprAST('>',$1,$3); }
+| exp "==" exp          { $$ = new (drv) BinaryExprAST('=',$1,$3); }
+// likely e unlikely indicano la probabilità di una condizione; any e all
+// riducono una maschera (confronto fra vettori) a una condizione. Non sono
+// parole riservate: restano utilizzabili come nomi
+| "id" "(" condexp ")"  { char op = $1 == "likely" ? 'l' : $1 == "unlikely" ? 'u'
+                                  : $1 == "any" ? 'E' : $1 == "all" ? 'F' : 0;
+                          if (!op)
+                            throw yy::parser::syntax_error (@1, "invalid condition: " + $1.str());
+                          $$ = new (drv) BinaryExprAST(op,$3); };
 
 idexp:
-  "id"                  { $$ = new VariableExprAST($1); }
-| "id" "(" optexp ")"   { $$ = new CallExprAST($1,$3); }
-| "id" "[" exp "]"      { $$ = new ArrayExprAST($1,$3); }; //NEW
+  "id"                  { $$ = new (drv) VariableExprAST($1); }
+| "id" "(" optexp ")"   { $$ = new (drv) CallExprAST($1,drv.copy($3)); }
+| "id" "[" exp "]"      { $$ = new (drv) ArrayExprAST($1,$3); }; //NEW
 
 optexp:
   %empty                { std::vector<ExprAST*> args;
@@ -230,23 +299,40 @@ explist:
                          args.push_back($1);
 			                   $$ = args;
                         }
-| exp "," explist       { $3.insert($3.begin(), $1); $$ = $3; };
+| explist "," exp       { $1.push_back($3); $$ = std::move($1); };
  
 %right "else" ")";
 
 ifstmt:
-  "if" "(" condexp ")" stmt                          { $$ = new IfStmtAST($3, $5); }
-| "if" "(" condexp ")" stmt "else" stmt              { $$ = new IfStmtAST($3, $5, $7); };
+  "if" "(" condexp ")" stmt                          { $$ = new (drv) IfStmtAST($3, $5); }
+| "if" "(" condexp ")" stmt "else" stmt              { $$ = new (drv) IfStmtAST($3, $5, $7); };
 
 init:
-  binding              { $$ = new VarOperation($1); }
-| assignment           { $$ = new VarOperation($1); };
+  binding              { $$ = new (drv) VarOperation($1); }
+| assignment           { $$ = new (drv) VarOperation($1); };
 
 forstmt:
-  "for" "(" init ";" condexp ";" assignment ")" stmt { $$ = new ForStmtAST($3, $5, $7, $9);};
+  "for" "(" init ";" condexp ";" assignment ")" stmt { $$ = new (drv) ForStmtAST($3, $5, $7, $9);};
 
 whilestmt:
-  "while" "(" condexp ")" stmt                       { $$ = new WhileStmtAST($3, $5); };
+  "while" "(" condexp ")" stmt                       { $$ = new (drv) WhileStmtAST($3, $5); };
+
+// Un ciclo può essere preceduto da suggerimenti di ottimizzazione, ad esempio
+// #vectorize(width=8) #unroll(4) for (...) ...
+loopstmt:
+  forstmt               { $$ = $1; }
+| whilestmt             { $$ = $1; }
+| hint loopstmt         { if (!$2->addHint($1.first, $1.second))
+                            throw yy::parser::syntax_error (@1, "invalid loop hint: " + $1.first.str());
+                          $$ = $2; };
+
+hint:
+  "#" "id"                              { $$ = std::make_pair($2, -1); }
+| "#" "id" "(" "number" ")"             { $$ = std::make_pair($2, hint_arg (@4, $4)); }
+| "#" "id" "(" "id" "=" "number" ")"    { if (!($2 == "vectorize" && $4 == "width") &&
+                                              !(($2 == "interleave" || $2 == "unroll") && $4 == "count"))
+                                            throw yy::parser::syntax_error (@4, "invalid loop hint argument: " + $4.str());
+                                          $$ = std::make_pair($2, hint_arg (@6, $6)); };
 
 %%
 
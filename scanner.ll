@@ -4,11 +4,15 @@
 # include <cstdlib>
 # include <string>
 # include <cmath>
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
 # include "driver.hpp"
 # include "parser.hpp"
 %}
 
-%option noyywrap nounput batch debug noinput
+%option noyywrap nounput batch debug noinput reentrant
 
 id      [a-zA-Z][a-zA-Z_0-9]*
 fpnum   [0-9]*\.?[0-9]+([eE][-+]?[0-9]+)?
@@ -51,6 +55,7 @@ blank   [ \t]
 "}"      return yy::parser::make_RBRACE    (loc);
 "["      return yy::parser::make_LSQBR     (loc);
 "]"      return yy::parser::make_RSQBR     (loc);
+"#"      return yy::parser::make_HASH      (loc);
 
 {num}    { errno = 0;
            double n = strtod(yytext, NULL);
@@ -72,7 +77,7 @@ blank   [ \t]
 "or"     { return yy::parser::make_OR(loc); }
 "not"    { return yy::parser::make_NOT(loc); }
 
-{id}     { return yy::parser::make_IDENTIFIER (yytext, loc); }
+{id}     { return yy::parser::make_IDENTIFIER (drv.intern (StringRef (yytext, yyleng)), loc); }
 
 .        { throw yy::parser::syntax_error
                (loc, "invalid character: " + std::string(yytext));
@@ -81,19 +86,69 @@ blank   [ \t]
 <<EOF>>  { return yy::parser::make_END (loc); }
 %%
 
-void driver::scan_begin () {
-  yy_flex_debug = trace_scanning;
+// Lo stato dello scanner è allocato per ogni file (e dunque per ogni driver),
+// così che più file possano essere analizzati contemporaneamente.
+// Il file sorgente viene mappato in memoria e analizzato sul posto con
+// yy_scan_buffer, senza copie né letture bufferizzate; gli identificatori
+// sono viste nella mappatura. Flex richiede che il buffer termini con due
+// caratteri nulli e lo modifica durante l'analisi (scrive temporaneamente un
+// terminatore dopo ogni token): il file è quindi mappato in modo privato
+// (copy-on-write) sopra una regione anonima, azzerata, più lunga di due byte.
+// Lo standard input e i file che non possono essere mappati (ad esempio le
+// pipe) sono letti da flex attraverso stdio
+bool driver::scan_begin () {
+  yylex_init (&scanner);
+  yyset_debug (opts.trace_scanning, scanner);
+  FILE *in;
   if (file.empty () || file == "-")
-    yyin = stdin;
-  else if (!(yyin = fopen (file.c_str (), "r")))
+    in = stdin;
+  else
     {
-      std::cerr << "cannot open " << file << ": " << strerror(errno) << '\n';
-      exit (EXIT_FAILURE);
+      int fd = open (file.c_str (), O_RDONLY);
+      if (fd < 0)
+        {
+          std::cerr << "cannot open " << file << ": " << strerror(errno) << '\n';
+          yylex_destroy (scanner);
+          return false;
+        }
+      struct stat st;
+      if (fstat (fd, &st) == 0 && S_ISREG (st.st_mode))
+        {
+          size_t size = st.st_size + 2;
+          void *base = mmap (nullptr, size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+          if (base != MAP_FAILED &&
+              (st.st_size == 0 ||
+               mmap (base, st.st_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED))
+            {
+              close (fd);
+              madvise (base, size, MADV_SEQUENTIAL);
+              input = static_cast<char *> (base);
+              input_size = size;
+              yy_scan_buffer (input, input_size, scanner);
+              return true;
+            }
+          if (base != MAP_FAILED)
+            munmap (base, size);
+        }
+      in = fdopen (fd, "r");
     }
+  yyset_in (in, scanner);
+  return true;
 }
 
 void
 driver::scan_end ()
 {
-  fclose (yyin);
+  if (!input)
+    fclose (yyget_in (scanner));
+  yylex_destroy (scanner);
+  if (input)
+    {
+      // Gli identificatori internati puntano nella mappatura
+      identifiers.clear ();
+      munmap (input, input_size);
+      input = nullptr;
+    }
 }
@@ -0,0 +1,34 @@
+#include <iostream>
+
+extern "C" {
+    double somma(double *, double);
+    double scala(double *, double, double);
+    double primi4(double *);
+    double quadrati(double);
+    double grande();
+    double ricorsiva(double, double);
+}
+
+// Chiamata da quadrati con l'array allocato sul heap
+extern "C" double printval(double *v, double n) {
+    for (int i = 0; i < n; i++)
+        std::cout << v[i] << (i + 1 < n ? " " : "\n");
+    return 0.0;
+}
+
+int main() {
+    double n;
+    std::cout << "Inserisci il valore di n: ";
+    std::cin >> n;
+    double V[5] = {1, 2, 3, 4, 5};
+    std::cout << "somma(V, 5) = " << somma(V, 5) << " (attesa 15)" << std::endl;
+    std::cout << "primi4(V) = " << primi4(V) << " (attesa 10)" << std::endl;
+    scala(V, 5, n);
+    std::cout << "scala(V, 5, n): V =";
+    for (double x : V)
+        std::cout << " " << x;
+    std::cout << std::endl;
+    std::cout << "quadrati(n) = " << quadrati(n) << " (attesa " << (n - 1) * n * (2 * n - 1) / 6 << ")" << std::endl;
+    std::cout << "grande() = " << grande() << " (attesa 100000)" << std::endl;
+    std::cout << "ricorsiva(100000, 0) = " << ricorsiva(100000, 0) << " (attesa 5.00005e+09)" << std::endl;
+}
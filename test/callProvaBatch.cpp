@@ -0,0 +1,53 @@
+#include <iostream>
+#include <vector>
+// Generato con ../kcomp --batch-threads --header=provaBatch.h
+#include "provaBatch.h"
+
+// Confronta out[i] con poly(x[i], y[i]) per ogni i
+static void confronta(const char *nome, const std::vector<double> &x, const std::vector<double> &y,
+                      const std::vector<double> &out, long n) {
+    int errori = 0;
+    for (long i = 0; i < n; i++)
+        if (out[i] != poly(x[i], y[i])) {
+            std::cout << nome << ": elemento " << i << " = " << out[i]
+                      << " invece di " << poly(x[i], y[i]) << std::endl;
+            errori++;
+        }
+    std::cout << nome << (errori ? ": ERRATO" : ": ok") << std::endl;
+}
+
+int main() {
+    double n;
+    std::cout << "Inserisci il numero di elementi n: ";
+    std::cin >> n;
+    long len = n > 0 ? (long)n : 0;
+    std::vector<double> x(len + 1), y(len + 1), out(len + 1, -1.0);
+    for (long i = 0; i < len; i++) {
+        x[i] = i * 0.5 - 3;
+        y[i] = (i % 7) - 2.25;
+    }
+    poly_batch(x.data(), y.data(), out.data(), len);
+    confronta("poly_batch", x, y, out, len);
+    std::fill(out.begin(), out.end(), -1.0);
+    poly_batch_mt(x.data(), y.data(), out.data(), len, 3);
+    confronta("poly_batch_mt (3 thread)", x, y, out, len);
+    std::fill(out.begin(), out.end(), -1.0);
+    poly_batch_mt(x.data(), y.data(), out.data(), len, 0);
+    confronta("poly_batch_mt (un thread per core)", x, y, out, len);
+    // L'elemento oltre n non deve essere scritto
+    std::cout << "out[n] = " << out[len] << std::endl;
+
+    // n = 0: nessun elemento viene scritto
+    std::fill(out.begin(), out.end(), -1.0);
+    poly_batch(x.data(), y.data(), out.data(), 0);
+    poly_batch_mt(x.data(), y.data(), out.data(), 0, 4);
+    std::cout << "n = 0: out[0] = " << out[0] << std::endl;
+
+    // out coincide con il primo ingresso
+    std::vector<double> z = x;
+    poly_batch(z.data(), y.data(), z.data(), len);
+    confronta("poly_batch con out = x", x, y, z, len);
+    z = x;
+    poly_batch_mt(z.data(), y.data(), z.data(), len, 3);
+    confronta("poly_batch_mt con out = x", x, y, z, len);
+}
@@ -0,0 +1,23 @@
+#include <iostream>
+
+extern "C" {
+    double mcd(double, double);
+    double sommaFino(double, double);
+    double fattoriale(double);
+    double incrementa(double *, double);
+}
+
+int main() {
+    double n;
+    std::cout << "Inserisci il valore di n: ";
+    std::cin >> n;
+    // Senza la trasformazione in ciclo queste ricorsioni, profonde n e 10n
+    // chiamate, esaurirebbero lo stack già per n = 1000000
+    std::cout << "mcd(n, 1) = " << mcd(n, 1) << std::endl;
+    std::cout << "mcd(6n, 4n) = " << mcd(6 * n, 4 * n) << std::endl;
+    std::cout << "sommaFino(10n, 0) = " << sommaFino(10 * n, 0) << std::endl;
+    // Ricorsioni non trasformate (si vedano le remark con -Rpass-missed=tailrec)
+    std::cout << "fattoriale(10) = " << fattoriale(10) << std::endl;
+    double a[1] = {0};
+    std::cout << "incrementa(a, 100) = " << incrementa(a, 100) << std::endl;
+}
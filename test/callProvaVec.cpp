@@ -0,0 +1,50 @@
+#include <iostream>
+
+extern "C" {
+    double initVec(double);
+    double dotVec();
+    double dotScal();
+    double maxVec();
+    double maxScal();
+    double revVec();
+    double revScal();
+    double mixVec();
+    double mixScal();
+    double anyVec();
+    double anyScal();
+    double laneVec(double);
+    double laneScal(double);
+    extern double VC[16], SC[16];
+}
+
+// Confronta elemento per elemento i risultati della versione vettoriale
+// (VC) e di quella scalare (SC)
+static void confronta(const char *nome) {
+    int errori = 0;
+    for (int i = 0; i < 16; i++)
+        if (VC[i] != SC[i]) {
+            std::cout << nome << ": elemento " << i << " = " << VC[i]
+                      << " invece di " << SC[i] << std::endl;
+            errori++;
+        }
+    std::cout << nome << (errori ? ": ERRATO" : ": ok") << std::endl;
+}
+
+int main() {
+    double x;
+    std::cout << "Inserisci il valore di x: ";
+    std::cin >> x;
+    initVec(x);
+    std::cout << "dotVec() = " << dotVec() << ", dotScal() = " << dotScal() << std::endl;
+    maxVec();
+    maxScal();
+    confronta("max");
+    revVec();
+    revScal();
+    confronta("shuffle");
+    mixVec();
+    mixScal();
+    confronta("shuffle di due vettori");
+    std::cout << "anyVec() = " << anyVec() << ", anyScal() = " << anyScal() << std::endl;
+    std::cout << "laneVec(x) = " << laneVec(x) << ", laneScal(x) = " << laneScal(x) << std::endl;
+}